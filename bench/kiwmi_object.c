@@ -0,0 +1,147 @@
+/* Copyright (c), Niclas Meyer <niclas@countingsort.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+// Micro-benchmark of luaK_get_kiwmi_object() and luaK_push_kiwmi_object().
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <lauxlib.h>
+
+#include "clock.h"
+#include "luak/luak.h"
+
+#define OBJECTS 4096
+#define ROUNDS 256
+
+// Only their addresses matter.
+static char objects[OBJECTS];
+
+// Just the parts of luaK_create() the object registry depends on.
+static struct kiwmi_lua *
+bench_lua_create(void)
+{
+    struct kiwmi_lua *lua = calloc(1, sizeof(*lua));
+    if (!lua) {
+        return NULL;
+    }
+
+    lua_State *L = luaL_newstate();
+    if (!L) {
+        free(lua);
+        return NULL;
+    }
+
+    lua->L = L;
+
+    hashmap_init(&lua->objects);
+    luaK_userdata_cache_init(lua);
+
+    luaL_newmetatable(L, "kiwmi_bench");
+    lua_pushcfunction(L, luaK_kiwmi_object_gc);
+    lua_setfield(L, -2, "__gc");
+    lua_pop(L, 1);
+
+    return lua;
+}
+
+static void
+bench_lua_destroy(struct kiwmi_lua *lua)
+{
+    lua_close(lua->L);
+    hashmap_fini(&lua->objects);
+    free(lua);
+}
+
+static void
+report(const char *name, uint64_t nsec, size_t ops)
+{
+    printf("%-16s %8.1f ns/op\n", name, (double)nsec / ops);
+}
+
+static void
+push_all(struct kiwmi_lua *lua)
+{
+    for (size_t i = 0; i < OBJECTS; ++i) {
+        luaK_push_kiwmi_object(lua->L, lua, &objects[i], NULL, "kiwmi_bench");
+        lua_pop(lua->L, 1);
+    }
+}
+
+// Wraps every object for the first time, then lets the GC collect them.
+static void
+bench_push_new(struct kiwmi_lua *lua)
+{
+    uint64_t total_nsec = 0;
+
+    for (size_t round = 0; round < ROUNDS; ++round) {
+        uint64_t start_nsec = clock_now_nsec();
+        push_all(lua);
+        total_nsec += clock_now_nsec() - start_nsec;
+
+        lua_gc(lua->L, LUA_GCCOLLECT, 0);
+    }
+
+    report("push (new)", total_nsec, (size_t)ROUNDS * OBJECTS);
+}
+
+static void
+bench_push_cached(struct kiwmi_lua *lua)
+{
+    uint64_t start_nsec = clock_now_nsec();
+    for (size_t round = 0; round < ROUNDS; ++round) {
+        push_all(lua);
+    }
+
+    report(
+        "push (cached)",
+        clock_now_nsec() - start_nsec,
+        (size_t)ROUNDS * OBJECTS);
+}
+
+static void
+bench_get(struct kiwmi_lua *lua)
+{
+    uint64_t start_nsec = clock_now_nsec();
+    for (size_t round = 0; round < ROUNDS; ++round) {
+        for (size_t i = 0; i < OBJECTS; ++i) {
+            struct kiwmi_object *obj =
+                luaK_get_kiwmi_object(lua, &objects[i], NULL);
+            --obj->refcount;
+        }
+    }
+
+    report("get", clock_now_nsec() - start_nsec, (size_t)ROUNDS * OBJECTS);
+}
+
+int
+main(void)
+{
+    struct kiwmi_lua *lua = bench_lua_create();
+    if (!lua) {
+        fprintf(stderr, "Failed to create Lua state\n");
+        return EXIT_FAILURE;
+    }
+
+    bench_push_new(lua);
+
+    // Keep every userdata alive, so pushes hit the cache and gets the map.
+    lua_createtable(lua->L, OBJECTS, 0);
+    for (size_t i = 0; i < OBJECTS; ++i) {
+        luaK_push_kiwmi_object(lua->L, lua, &objects[i], NULL, "kiwmi_bench");
+        lua_rawseti(lua->L, -2, i + 1);
+    }
+
+    bench_push_cached(lua);
+    bench_get(lua);
+
+    lua_pop(lua->L, 1);
+
+    bench_lua_destroy(lua);
+
+    return EXIT_SUCCESS;
+}
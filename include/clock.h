@@ -0,0 +1,17 @@
+/* Copyright (c), Niclas Meyer <niclas@countingsort.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef KIWMI_CLOCK_H
+#define KIWMI_CLOCK_H
+
+#include <stdint.h>
+#include <time.h>
+
+uint64_t clock_now_nsec(void);
+uint64_t timespec_to_nsec(const struct timespec *ts);
+
+#endif /* KIWMI_CLOCK_H */
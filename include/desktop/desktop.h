@@ -13,6 +13,8 @@
 
 #include "desktop/stratum.h"
 
+#define KIWMI_OCCLUDED_FRAME_INTERVAL_DEFAULT 1000
+
 struct kiwmi_desktop {
     struct wlr_compositor *compositor;
 
@@ -22,10 +24,27 @@ struct kiwmi_desktop {
 
     struct wlr_data_device_manager *data_device_manager;
 
+    struct wlr_output_manager_v1 *output_manager;
+
     struct wlr_output_layout *output_layout;
     struct wl_list outputs; // struct kiwmi_output::link
+    int output_batch_depth;
+    bool output_layout_dirty;
+    // topology changes are collected until the next idle or until no change
+    // happened for output_debounce ms
+    int output_debounce;
+    bool output_change_pending;
+    struct wl_event_source *output_change_timer;
+    struct wl_event_source *output_change_idle;
     struct wl_list views;   // struct kiwmi_view::link
 
+    int transaction_depth;
+    struct kiwmi_transaction *transaction;         // being recorded
+    struct kiwmi_transaction *pending_transaction; // waiting for clients
+
+    // ms between frame callbacks of fully occluded surfaces, 0 stops them
+    int occluded_frame_interval;
+
     struct wlr_scene *scene;
     struct wlr_scene_rect *background_rect;
     struct wlr_scene_tree *strata[KIWMI_STRATA_COUNT];
@@ -35,9 +54,12 @@ struct kiwmi_desktop {
     struct wl_listener layer_shell_new_surface;
     struct wl_listener new_output;
     struct wl_listener output_layout_change;
+    struct wl_listener output_manager_apply;
+    struct wl_listener output_manager_test;
 
     struct {
         struct wl_signal new_output;
+        struct wl_signal outputs_change;
         struct wl_signal view_map;
         struct wl_signal request_active_output;
     } events;
@@ -8,11 +8,61 @@
 #ifndef KIWMI_DESKTOP_OUTPUT_H
 #define KIWMI_DESKTOP_OUTPUT_H
 
+#include <stdint.h>
+
 #include <wayland-server.h>
 #include <wlr/util/box.h>
 
 #include "desktop/stratum.h"
 
+#define KIWMI_FRAME_STATS_SAMPLES 128
+#define KIWMI_FRAME_STATS_BUCKETS 8
+
+#define KIWMI_MAX_RENDER_TIME_AUTO -1
+#define KIWMI_MAX_RENDER_TIME_WINDOW 32
+
+enum kiwmi_adaptive_sync {
+    KIWMI_ADAPTIVE_SYNC_OFF,
+    KIWMI_ADAPTIVE_SYNC_ON,
+    // only while a latency sensitive view covers the output
+    KIWMI_ADAPTIVE_SYNC_AUTO,
+};
+
+struct kiwmi_frame_sample {
+    uint64_t frame_to_commit_nsec; // frame event until commit started
+    uint64_t commit_nsec;          // duration of the scene commit
+    uint64_t present_nsec;         // end of commit until presentation
+};
+
+struct kiwmi_frame_stats {
+    // ring buffer of the most recent committed frames
+    struct kiwmi_frame_sample samples[KIWMI_FRAME_STATS_SAMPLES];
+    size_t head;
+    size_t count;
+
+    // commit durations, bucket i holds durations below 250us << i
+    uint64_t histogram[KIWMI_FRAME_STATS_BUCKETS];
+
+    uint64_t frames;
+    uint64_t skipped;
+    uint64_t missed_vblanks;
+
+    // how the committed frames were presented
+    uint64_t vsync_frames;
+    uint64_t vrr_frames;
+
+    // frames delayed until the render deadline or rendered right away
+    // for a latency sensitive view
+    uint64_t deadline_frames;
+    uint64_t immediate_frames;
+
+    // frame callbacks withheld from fully occluded surfaces
+    uint64_t occluded_callbacks;
+
+    uint64_t last_commit_end_nsec;
+    bool awaiting_present;
+};
+
 struct kiwmi_output {
     struct wl_list link;
     struct kiwmi_desktop *desktop;
@@ -22,12 +72,40 @@ struct kiwmi_output {
     struct wl_listener commit;
     struct wl_listener destroy;
     struct wl_listener mode;
+    struct wl_listener present;
 
     struct wl_list layers[4]; // struct kiwmi_layer::link
     struct wlr_scene_tree *strata[KIWMI_STRATA_COUNT];
 
     struct wlr_box usable_area;
 
+    // Forces a repaint on the next frame, set by output_schedule_frame(),
+    // which also damages the whole output so the commit isn't rolled back.
+    bool needs_frame;
+
+    struct kiwmi_frame_stats frame_stats;
+
+    // Render deadline in ms before the predicted vblank, 0 renders right
+    // away, KIWMI_MAX_RENDER_TIME_AUTO derives it from the recent frames.
+    int max_render_time;
+    struct wl_event_source *repaint_timer;
+    bool repaint_pending;
+    uint64_t frame_nsec;
+    uint64_t last_present_nsec;
+    int refresh_nsec;
+
+    enum kiwmi_adaptive_sync adaptive_sync;
+    bool adaptive_sync_failed;
+
+    // latency sensitive views covering the whole output
+    int latency_sensitive_views;
+
+    // last time fully occluded surfaces got a frame callback
+    uint64_t occluded_frame_done_nsec;
+
+    // set while a batch defers arrange_layers() and the resize event
+    bool arrange_pending;
+
     struct {
         struct wl_signal destroy;
         struct wl_signal resize;
@@ -45,6 +123,28 @@ struct kiwmi_render_data {
 };
 
 void new_output_notify(struct wl_listener *listener, void *data);
+void output_schedule_frame(struct kiwmi_output *output);
+int output_max_render_time(struct kiwmi_output *output);
+bool output_set_adaptive_sync(
+    struct kiwmi_output *output,
+    enum kiwmi_adaptive_sync adaptive_sync);
+void output_update_latency_sensitive_views(
+    struct kiwmi_output *output,
+    int delta);
+uint64_t output_frame_stats_bucket_limit(size_t bucket);
 void output_layout_change_notify(struct wl_listener *listener, void *data);
 
+// Layout and layer updates between these are coalesced and run once at the
+// end of the outermost batch.
+void output_batch_begin(struct kiwmi_desktop *desktop);
+void output_batch_end(struct kiwmi_desktop *desktop);
+
+// Topology changes (hotplug, modes, layout) open a batch which is closed on
+// the next idle or after the debounce window, emitting outputs_change once.
+void output_change_schedule(struct kiwmi_desktop *desktop);
+// Closes the batch early, for anything that needs the current topology, like
+// output queries and placing views.
+void output_change_flush(struct kiwmi_desktop *desktop);
+int output_change_timer_notify(void *data);
+
 #endif /* KIWMI_DESKTOP_OUTPUT_H */
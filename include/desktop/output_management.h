@@ -0,0 +1,50 @@
+/* Copyright (c), Niclas Meyer <niclas@countingsort.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef KIWMI_DESKTOP_OUTPUT_MANAGEMENT_H
+#define KIWMI_DESKTOP_OUTPUT_MANAGEMENT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <wayland-server.h>
+
+struct kiwmi_desktop;
+
+struct kiwmi_output_config {
+    struct kiwmi_output *output;
+    bool enabled;
+
+    // If mode is NULL and width is set, the closest matching mode is used,
+    // falling back to a custom mode.
+    struct wlr_output_mode *mode;
+    int32_t width;
+    int32_t height;
+    int32_t refresh; // mHz, 0 picks the highest
+
+    bool has_position;
+    int32_t x;
+    int32_t y;
+
+    float scale; // <= 0 keeps the current scale
+
+    bool has_transform;
+    enum wl_output_transform transform;
+};
+
+bool output_config_apply(
+    struct kiwmi_desktop *desktop,
+    struct kiwmi_output_config *configs,
+    size_t count,
+    bool test_only);
+
+void output_manager_update(struct kiwmi_desktop *desktop);
+void output_manager_apply_notify(struct wl_listener *listener, void *data);
+void output_manager_test_notify(struct wl_listener *listener, void *data);
+
+#endif /* KIWMI_DESKTOP_OUTPUT_MANAGEMENT_H */
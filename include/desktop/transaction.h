@@ -0,0 +1,65 @@
+/* Copyright (c), Niclas Meyer <niclas@countingsort.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef KIWMI_DESKTOP_TRANSACTION_H
+#define KIWMI_DESKTOP_TRANSACTION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <wayland-server.h>
+
+// ms to wait for clients before applying a transaction anyway
+#define KIWMI_TRANSACTION_TIMEOUT 200
+
+struct kiwmi_desktop;
+struct kiwmi_view;
+
+struct kiwmi_transaction_instruction {
+    struct wl_list link; // struct kiwmi_transaction::instructions
+    struct kiwmi_view *view;
+
+    bool has_pos;
+    uint32_t x;
+    uint32_t y;
+
+    bool has_size;
+    uint32_t width;
+    uint32_t height;
+
+    uint32_t serial; // configure the client has to ack and commit
+    bool ready;
+};
+
+// Geometry changes recorded while a transaction is open are sent as one
+// batch of configures. The new positions are applied together once every
+// client committed its new size, or after KIWMI_TRANSACTION_TIMEOUT.
+struct kiwmi_transaction {
+    struct kiwmi_desktop *desktop;
+    struct wl_list instructions; // struct kiwmi_transaction_instruction::link
+    size_t waiting;
+    struct wl_event_source *timer;
+};
+
+// Transactions nest, only the outermost transaction_commit() sends them.
+void transaction_begin(struct kiwmi_desktop *desktop);
+void transaction_commit(struct kiwmi_desktop *desktop);
+void transaction_fini(struct kiwmi_desktop *desktop);
+
+// Return false if no transaction is open. The change is then applied right
+// away by the caller, so it's dropped from the transaction waiting for
+// clients, if any.
+bool transaction_record_pos(struct kiwmi_view *view, uint32_t x, uint32_t y);
+bool transaction_record_size(
+    struct kiwmi_view *view,
+    uint32_t width,
+    uint32_t height);
+
+void transaction_view_ack(struct kiwmi_view *view, uint32_t serial);
+void transaction_view_destroy(struct kiwmi_view *view);
+
+#endif /* KIWMI_DESKTOP_TRANSACTION_H */
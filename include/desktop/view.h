@@ -19,6 +19,8 @@
 
 #include "desktop/desktop_surface.h"
 
+struct kiwmi_output;
+
 enum kiwmi_view_prop {
     KIWMI_VIEW_PROP_APP_ID,
     KIWMI_VIEW_PROP_TITLE,
@@ -51,9 +53,15 @@ struct kiwmi_view {
     struct wl_listener destroy;
     struct wl_listener request_move;
     struct wl_listener request_resize;
+    struct wl_listener set_title;
 
     bool mapped;
 
+    // Rendered without a deadline while covering a whole output.
+    bool latency_sensitive;
+    // counted in kiwmi_output::latency_sensitive_views
+    struct kiwmi_output *covered_output;
+
     struct {
         struct wl_signal unmap;
         struct wl_signal request_move;
@@ -69,7 +77,9 @@ struct kiwmi_view_impl {
     void (*close)(struct kiwmi_view *view);
     pid_t (*get_pid)(struct kiwmi_view *view);
     void (*set_activated)(struct kiwmi_view *view, bool activated);
-    void (*set_size)(struct kiwmi_view *view, uint32_t width, uint32_t height);
+    // returns the serial of the configure or 0
+    uint32_t (
+        *set_size)(struct kiwmi_view *view, uint32_t width, uint32_t height);
     const char *(
         *get_string_prop)(struct kiwmi_view *view, enum kiwmi_view_prop prop);
     void (*set_tiled)(struct kiwmi_view *view, enum wlr_edges edges);
@@ -86,10 +96,18 @@ void view_get_size(struct kiwmi_view *view, uint32_t *width, uint32_t *height);
 const char *view_get_app_id(struct kiwmi_view *view);
 const char *view_get_title(struct kiwmi_view *view);
 void view_set_activated(struct kiwmi_view *view, bool activated);
+uint32_t view_configure_size(
+    struct kiwmi_view *view,
+    uint32_t width,
+    uint32_t height);
 void view_set_size(struct kiwmi_view *view, uint32_t width, uint32_t height);
+// Only moves the scene nodes, without refreshing the pointer focus.
+void view_move_nodes(struct kiwmi_view *view, uint32_t x, uint32_t y);
 void view_set_pos(struct kiwmi_view *view, uint32_t x, uint32_t y);
 void view_set_tiled(struct kiwmi_view *view, enum wlr_edges edges);
 void view_set_hidden(struct kiwmi_view *view, bool hidden);
+// Has to be called whenever the view might start or stop covering an output.
+void view_update_latency_sensitive(struct kiwmi_view *view);
 
 void view_focus(struct kiwmi_view *view);
 struct kiwmi_view *view_at(struct kiwmi_desktop *desktop, double lx, double ly);
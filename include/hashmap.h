@@ -0,0 +1,35 @@
+/* Copyright (c), Niclas Meyer <niclas@countingsort.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef KIWMI_HASHMAP_H
+#define KIWMI_HASHMAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Open addressing map from 64 bit keys to non-NULL pointers.
+struct kiwmi_hashmap {
+    struct kiwmi_hashmap_entry *entries;
+    size_t capacity; // power of two, 0 until the first insert
+    size_t len;
+};
+
+struct kiwmi_hashmap_entry {
+    uint64_t key;
+    void *value; // NULL marks an empty slot
+};
+
+void hashmap_init(struct kiwmi_hashmap *map);
+void hashmap_fini(struct kiwmi_hashmap *map);
+void *hashmap_get(struct kiwmi_hashmap *map, uint64_t key);
+// Replaces an existing value. Returns false if growing the map failed.
+bool hashmap_insert(struct kiwmi_hashmap *map, uint64_t key, void *value);
+// Returns the removed value or NULL.
+void *hashmap_remove(struct kiwmi_hashmap *map, uint64_t key);
+
+#endif /* KIWMI_HASHMAP_H */
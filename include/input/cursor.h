@@ -34,6 +34,21 @@ struct kiwmi_cursor {
         uint32_t resize_edges;
     } grabbed;
 
+    // motion since the last output frame, for events.motion_coalesced
+    struct {
+        bool pending;
+        double oldx;
+        double oldy;
+    } coalesced_motion;
+
+    // pointer focus refreshes are deferred to the next idle
+    bool focus_dirty;
+    struct wl_event_source *focus_idle;
+    struct {
+        uint64_t refreshes; // scene hit-tests actually done
+        uint64_t avoided;   // requests coalesced into another refresh
+    } focus_stats;
+
     struct wl_listener cursor_motion;
     struct wl_listener cursor_motion_absolute;
     struct wl_listener cursor_button;
@@ -45,6 +60,7 @@ struct kiwmi_cursor {
         struct wl_signal button_up;
         struct wl_signal destroy;
         struct wl_signal motion;
+        struct wl_signal motion_coalesced;
         struct wl_signal scroll;
     } events;
 };
@@ -74,6 +90,11 @@ void cursor_refresh_focus(
     double *cursor_sx,
     double *cursor_sy);
 
+// Refreshes the pointer focus once the current event loop iteration is done.
+void cursor_schedule_refresh_focus(struct kiwmi_cursor *cursor);
+
+void cursor_flush_motion(struct kiwmi_cursor *cursor);
+
 struct kiwmi_cursor *cursor_create(
     struct kiwmi_server *server,
     struct wlr_output_layout *output_layout);
@@ -10,6 +10,8 @@
 
 #include <wayland-server.h>
 
+#include "hashmap.h"
+
 struct kiwmi_input {
     struct wl_list keyboards; // struct kiwmi_keyboard::link
     struct wl_list pointers;  // struct kiwmi_pointer::link
@@ -17,6 +19,9 @@ struct kiwmi_input {
     struct kiwmi_cursor *cursor;
     struct kiwmi_seat *seat;
 
+    // keybinds of all keyboards, checked after the keyboard's own
+    struct kiwmi_hashmap keybinds; // struct kiwmi_keybind
+
     struct {
         struct wl_signal keyboard_new;
     } events;
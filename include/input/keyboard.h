@@ -8,11 +8,17 @@
 #ifndef KIWMI_INPUT_KEYBOARD_H
 #define KIWMI_INPUT_KEYBOARD_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include <wayland-server.h>
 #include <xkbcommon/xkbcommon.h>
 
+#include "hashmap.h"
+
+#define KIWMI_KEYBOARD_BOUND_KEYS 32
+
 struct kiwmi_keyboard {
     struct wl_list link;
     struct kiwmi_server *server;
@@ -21,6 +27,12 @@ struct kiwmi_keyboard {
     struct wl_listener key;
     struct wl_listener device_destroy;
 
+    struct kiwmi_hashmap keybinds; // struct kiwmi_keybind, see keybind_key()
+
+    // keys whose press triggered a keybind, their release is swallowed too
+    uint32_t bound_keys[KIWMI_KEYBOARD_BOUND_KEYS];
+    size_t bound_keys_len;
+
     struct {
         struct wl_signal key_down;
         struct wl_signal key_up;
@@ -38,8 +50,29 @@ struct kiwmi_keyboard_key_event {
     bool handled;
 };
 
+struct kiwmi_keybind {
+    uint32_t modifiers; // enum wlr_keyboard_modifier
+    xkb_keysym_t sym;
+    void (*handler)(
+        struct kiwmi_keybind *keybind,
+        struct kiwmi_keyboard *keyboard);
+    void (*destroy)(struct kiwmi_keybind *keybind);
+};
+
 struct kiwmi_keyboard *
 keyboard_create(struct kiwmi_server *server, struct wlr_input_device *device);
 void keyboard_destroy(struct kiwmi_keyboard *keyboard);
 
+uint64_t keybind_key(uint32_t modifiers, xkb_keysym_t sym);
+bool keybind_parse(const char *binding, uint32_t *modifiers, xkb_keysym_t *sym);
+// Replaces (and destroys) an existing keybind with the same key combination.
+bool keybinds_add(
+    struct kiwmi_hashmap *keybinds,
+    struct kiwmi_keybind *keybind);
+bool keybinds_remove(
+    struct kiwmi_hashmap *keybinds,
+    uint32_t modifiers,
+    xkb_keysym_t sym);
+void keybinds_clear(struct kiwmi_hashmap *keybinds);
+
 #endif /* KIWMI_INPUT_KEYBOARD_H */
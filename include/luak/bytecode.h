@@ -0,0 +1,19 @@
+/* Copyright (c), Niclas Meyer <niclas@countingsort.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef KIWMI_LUAK_BYTECODE_H
+#define KIWMI_LUAK_BYTECODE_H
+
+#include <lua.h>
+
+// luaL_loadfile(), but loads the precompiled chunk from
+// $XDG_CACHE_HOME/kiwmi if it is still up to date and stores it otherwise.
+int luaK_loadfile_cached(lua_State *L, const char *path);
+// Replaces the Lua file searcher of require() with one using the cache.
+void luaK_bytecode_install_searcher(lua_State *L);
+
+#endif /* KIWMI_LUAK_BYTECODE_H */
@@ -0,0 +1,45 @@
+/* Copyright (c), Niclas Meyer <niclas@countingsort.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef KIWMI_LUAK_CHUNK_CACHE_H
+#define KIWMI_LUAK_CHUNK_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <wayland-server.h>
+
+#include "hashmap.h"
+
+#define KIWMI_CHUNK_CACHE_CAPACITY 64
+// longer snippets are most likely one-off scripts, not worth keeping
+#define KIWMI_CHUNK_CACHE_MAX_SOURCE 4096
+
+struct kiwmi_lua;
+
+struct kiwmi_chunk_cache_stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+};
+
+// LRU cache of compiled IPC commands, so repeated commands skip the compiler.
+struct kiwmi_chunk_cache {
+    struct kiwmi_hashmap chunks; // struct kiwmi_chunk, keyed by source hash
+    struct wl_list lru;          // struct kiwmi_chunk::link, most recent first
+    size_t len;
+
+    struct kiwmi_chunk_cache_stats stats;
+};
+
+void luaK_chunk_cache_init(struct kiwmi_chunk_cache *cache);
+// The cached functions go away with the Lua state, this only frees the rest.
+void luaK_chunk_cache_fini(struct kiwmi_chunk_cache *cache);
+// Like luaL_loadstring(), but returns the cached function if there is one.
+int luaK_chunk_cache_load(struct kiwmi_lua *lua, const char *source);
+
+#endif /* KIWMI_LUAK_CHUNK_CACHE_H */
@@ -0,0 +1,53 @@
+/* Copyright (c), Niclas Meyer <niclas@countingsort.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef KIWMI_LUAK_COROUTINE_H
+#define KIWMI_LUAK_COROUTINE_H
+
+#include <stdbool.h>
+
+#include <lua.h>
+#include <wayland-server.h>
+
+#include "luak/luak.h"
+
+// A coroutine suspended until an event source resumes it.
+struct kiwmi_lua_waiter {
+    struct wl_list link; // struct kiwmi_lua::waiters
+    struct kiwmi_lua *lua;
+    lua_State *co;
+    int thread_ref;
+    int nargs; // values already moved onto the stack of co
+
+    struct wl_event_source *event_source; // sleep timer or deferred resume
+
+    // kiwmi:wait()
+    struct kiwmi_lua_callback *lc;
+    int object_ref;
+    struct wl_listener destroy;
+    bool fired;
+
+    // child:wait()
+    struct wl_list child_link; // struct kiwmi_child::waiters
+};
+
+// Runs the function below the nargs arguments on top of the stack as a new
+// coroutine.
+void luaK_coroutine_start(lua_State *L, struct kiwmi_lua *lua, int nargs);
+
+// Anchors the running coroutine, raises an error outside of coroutines.
+struct kiwmi_lua_waiter *luaK_waiter_new(lua_State *L, struct kiwmi_lua *lua);
+void luaK_waiter_resume(struct kiwmi_lua_waiter *waiter);
+// Resumes from an idle source, for events that can't run Lua reentrantly.
+void luaK_waiter_resume_later(struct kiwmi_lua_waiter *waiter);
+// Drops every suspended coroutine, the state has to be still open.
+void luaK_waiters_destroy(struct kiwmi_lua *lua);
+
+int luaK_sleep(lua_State *L, struct kiwmi_lua *lua, int delay);
+int luaK_wait(lua_State *L, struct kiwmi_lua *lua, int object, int event);
+
+#endif /* KIWMI_LUAK_COROUTINE_H */
@@ -0,0 +1,52 @@
+/* Copyright (c), Niclas Meyer <niclas@countingsort.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef KIWMI_LUAK_GC_H
+#define KIWMI_LUAK_GC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <wayland-server.h>
+
+#define KIWMI_GC_BUDGET_DEFAULT_NSEC 1000000
+// don't bother collecting until the heap reaches this many KiB
+#define KIWMI_GC_MIN_THRESHOLD_KB 512
+
+struct kiwmi_lua;
+
+struct kiwmi_gc_stats {
+    uint64_t runs;   // idle callbacks that did any work
+    uint64_t steps;  // lua_gc() steps
+    uint64_t cycles; // finished collection cycles
+    uint64_t total_nsec;
+    uint64_t max_nsec;
+    uint64_t last_nsec;
+};
+
+// The collector is stopped and only stepped from an idle source after a
+// frame was committed, so collection never lands in input or frame handling.
+struct kiwmi_gc {
+    struct wl_event_loop *event_loop;
+    struct wl_event_source *idle;
+
+    uint64_t budget_nsec; // per idle callback, 0 restores the automatic GC
+    bool in_cycle;
+    int threshold_kb; // heap size that starts the next cycle
+
+    struct kiwmi_gc_stats stats;
+};
+
+void luaK_gc_init(struct kiwmi_lua *lua, struct wl_event_loop *event_loop);
+void luaK_gc_fini(struct kiwmi_lua *lua);
+void luaK_gc_schedule(struct kiwmi_lua *lua);
+// For Lua code running outside of frames (callbacks, IPC), which would never
+// get collected without frames being committed.
+void luaK_gc_schedule_if_grown(struct kiwmi_lua *lua);
+void luaK_gc_set_budget(struct kiwmi_lua *lua, uint64_t budget_nsec);
+
+#endif /* KIWMI_LUAK_GC_H */
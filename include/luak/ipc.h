@@ -10,9 +10,19 @@
 
 #include <stdbool.h>
 
+#include "desktop/output.h"
+#include "desktop/view.h"
+#include "kiwmi-ipc-protocol.h"
 #include "luak/luak.h"
 #include "server.h"
 
 bool luaK_ipc_init(struct kiwmi_server *server, struct kiwmi_lua *lua);
+// Send an event to every event stream subscribed to type.
+void luaK_ipc_view_event(
+    struct kiwmi_view *view,
+    enum kiwmi_event_stream_type type);
+void luaK_ipc_output_event(
+    struct kiwmi_output *output,
+    enum kiwmi_event_stream_type type);
 
 #endif /* KIWMI_LUAK_IPC_H */
@@ -0,0 +1,23 @@
+/* Copyright (c), Niclas Meyer <niclas@countingsort.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef KIWMI_LUAK_JSON_H
+#define KIWMI_LUAK_JSON_H
+
+#include <stddef.h>
+
+#include <lua.h>
+
+// nesting deeper than this is most likely a reference cycle
+#define KIWMI_JSON_MAX_DEPTH 64
+
+// Encodes the value at idx as JSON. Tables with the keys 1..n become arrays,
+// other tables objects. Returns a malloc()ed string, or NULL with error set if
+// the value contains something JSON can't represent.
+char *luaK_json_encode(lua_State *L, int idx, size_t *len, const char **error);
+
+#endif /* KIWMI_LUAK_JSON_H */
@@ -0,0 +1,32 @@
+/* Copyright (c), Niclas Meyer <niclas@countingsort.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef KIWMI_LUAK_KIWMI_CHILD_H
+#define KIWMI_LUAK_KIWMI_CHILD_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include <lua.h>
+#include <wayland-server.h>
+
+// Lives in the userdata, so it's freed by Lua.
+struct kiwmi_child {
+    struct wl_list link; // struct kiwmi_lua::children
+    struct kiwmi_lua *lua;
+    pid_t pid;
+    bool exited;
+    int status;
+    struct wl_list waiters; // struct kiwmi_lua_waiter::child_link
+};
+
+int luaK_kiwmi_child_new(lua_State *L);
+int luaK_kiwmi_child_register(lua_State *L);
+// Listens to kiwmi_server::events.child_exit.
+void luaK_kiwmi_child_exit_notify(struct wl_listener *listener, void *data);
+
+#endif /* KIWMI_LUAK_KIWMI_CHILD_H */
@@ -10,6 +10,18 @@
 
 #include <lua.h>
 
+#include "hashmap.h"
+#include "input/keyboard.h"
+#include "luak/kiwmi_lua_callback.h"
+#include "luak/luak.h"
+
+int luaK_kiwmi_keybind_bind(
+    lua_State *L,
+    struct kiwmi_lua *lua,
+    struct kiwmi_hashmap *keybinds);
+struct kiwmi_lua_callback_stats *
+luaK_kiwmi_keybind_stats(struct kiwmi_keybind *keybind);
+int luaK_kiwmi_keybind_unbind(lua_State *L, struct kiwmi_hashmap *keybinds);
 int luaK_kiwmi_keyboard_new(lua_State *L);
 int luaK_kiwmi_keyboard_register(lua_State *L);
 
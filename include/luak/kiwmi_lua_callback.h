@@ -8,14 +8,33 @@
 #ifndef KIWMI_LUAK_KIWMI_LUA_CALLBACK_H
 #define KIWMI_LUAK_KIWMI_LUA_CALLBACK_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #include <lua.h>
 
 #include "luak/luak.h"
 
+struct kiwmi_lua_callback_stats {
+    char event[64];
+    uint64_t calls;
+    uint64_t total_nsec;
+    uint64_t max_nsec;
+};
+
 struct kiwmi_lua_callback {
     struct wl_list link;
     struct kiwmi_server *server;
     int callback_ref;
+    struct kiwmi_lua_callback_stats stats;
+    struct kiwmi_lua_callback **handle; // userdata returned by :on(), if any
+
+    // Removed callbacks stay on their signal until the next idle, the
+    // notify handlers skip them.
+    struct kiwmi_object *object;
+    bool dead;
+    struct wl_list dead_link; // struct kiwmi_lua::dead_callbacks
+
     union {
         struct wl_event_source *event_source;
         struct wl_listener listener;
@@ -23,5 +42,38 @@ struct kiwmi_lua_callback {
 };
 
 int luaK_kiwmi_lua_callback_new(lua_State *L);
+int luaK_kiwmi_lua_callback_register(lua_State *L);
+// Removes a callback created by luaK_kiwmi_lua_callback_new(), safe while its
+// signal is being emitted.
+void luaK_callback_free(struct kiwmi_lua *lua, struct kiwmi_lua_callback *lc);
+// Removes and frees lc right away, for when its object goes away.
+void luaK_callback_destroy(
+    struct kiwmi_lua *lua,
+    struct kiwmi_lua_callback *lc);
+// Pushes a kiwmi_lua_callback handle, which can remove lc with :off().
+void luaK_callback_push_handle(lua_State *L, struct kiwmi_lua_callback *lc);
+void luaK_callback_stats_init(
+    struct kiwmi_lua_callback_stats *stats,
+    const char *event);
+// Must be called before the stats get freed while a callback might run.
+void luaK_callback_stats_forget(
+    struct kiwmi_lua *lua,
+    struct kiwmi_lua_callback_stats *stats);
+// lua_pcall() for callbacks, accounts the time to stats and runs the
+// watchdog (see kiwmi:watchdog()).
+int luaK_callback_pcall(
+    struct kiwmi_lua *lua,
+    struct kiwmi_lua_callback_stats *stats,
+    int nargs,
+    int nresults);
+// luaC_resume() under the same watchdog as callbacks.
+int luaK_callback_resume(
+    struct kiwmi_lua *lua,
+    lua_State *from,
+    lua_State *co,
+    int nargs,
+    int *nres);
+// Lets the watchdog find lua from any of its threads.
+void luaK_watchdog_init(struct kiwmi_lua *lua);
 
 #endif /* KIWMI_LUAK_KIWMI_LUA_CALLBACK_H */
@@ -17,5 +17,11 @@
 #define luaC_newlib(L, l) (luaC_newlibtable(L, l), luaC_setfuncs(L, l, 0))
 
 void luaC_setfuncs(lua_State *L, const luaL_Reg *l, int nup);
+// lua_resume() of Lua 5.4, nres is set to the number of results or yielded
+// values on top of the stack.
+int luaC_resume(lua_State *L, lua_State *from, int narg, int *nres);
+// lua_dump() without stripping debug information
+int luaC_dump(lua_State *L, lua_Writer writer, void *data);
+size_t luaC_rawlen(lua_State *L, int idx);
 
 #endif /* KIWMI_LUAK_LUA_COMPAT_H */
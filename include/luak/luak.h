@@ -9,17 +9,59 @@
 #define KIWMI_LUAK_LUAK_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include <lua.h>
 #include <wayland-server.h>
 
+#include "hashmap.h"
+#include "luak/chunk_cache.h"
+#include "luak/gc.h"
 #include "server.h"
 
+struct kiwmi_lua_call {
+    struct kiwmi_lua_callback_stats *stats; // NULL once freed
+    struct kiwmi_lua_call *prev;
+};
+
+// Where IPC commands spend their time, compiling includes cache lookups.
+struct kiwmi_ipc_stats {
+    uint64_t commands;
+    uint64_t failures;
+    uint64_t total_nsec;
+    uint64_t max_nsec;
+    uint64_t compile_nsec; // luaL_loadstring() or the chunk cache
+    uint64_t run_nsec;     // the command itself
+    uint64_t format_nsec;  // tostring() or JSON encoding
+};
+
 struct kiwmi_lua {
     lua_State *L;
-    int objects;
+    struct kiwmi_server *server;
+    struct kiwmi_hashmap objects; // struct kiwmi_object, keyed by object
+    int userdata; // weak cache of the userdata wrapping each object
     struct wl_list scheduled_callbacks;
+    struct wl_list dead_callbacks; // struct kiwmi_lua_callback::dead_link
+    struct wl_event_source *dead_callbacks_idle;
     struct wl_global *global;
+    int ipc_commands; // commands registered over IPC, name to function
+    struct kiwmi_chunk_cache chunk_cache;
+    struct kiwmi_ipc_stats ipc_stats;
+
+    // slow callback watchdog, 0 ms disables it
+    int watchdog_ms;
+    bool watchdog_abort;
+    bool watchdog_fired;
+    uint64_t callback_start_nsec;
+    struct kiwmi_lua_call *calls; // innermost running callback
+
+    struct kiwmi_gc gc;
+
+    struct wl_list waiters;  // struct kiwmi_lua_waiter::link
+    struct wl_list children; // struct kiwmi_child::link
+    struct wl_listener child_exit;
+
+    struct wl_event_source *reload_idle; // pending kiwmi:reload()
 };
 
 struct kiwmi_object {
@@ -39,14 +81,27 @@ struct kiwmi_object {
 
 void *luaK_toudata(lua_State *L, int ud, const char *tname);
 int luaK_kiwmi_object_gc(lua_State *L);
+// Frees obj once neither Lua nor any callback refers to it anymore.
+void luaK_kiwmi_object_release(struct kiwmi_object *obj);
 struct kiwmi_object *luaK_get_kiwmi_object(
     struct kiwmi_lua *lua,
     void *ptr,
     struct wl_signal *destroy);
+// Raises a Lua error if the object can't be registered.
+void luaK_push_kiwmi_object(
+    lua_State *L,
+    struct kiwmi_lua *lua,
+    void *ptr,
+    struct wl_signal *destroy,
+    const char *tname);
 int luaK_callback_register_dispatch(lua_State *L);
+int luaK_callback_register_once(lua_State *L);
 int luaK_usertype_ref_equal(lua_State *L);
+// Creates the table luaK_push_kiwmi_object() reuses userdata from.
+void luaK_userdata_cache_init(struct kiwmi_lua *lua);
 struct kiwmi_lua *luaK_create(struct kiwmi_server *server);
 bool luaK_dofile(struct kiwmi_lua *lua, const char *config_path);
 void luaK_destroy(struct kiwmi_lua *lua);
+bool luaK_reload(struct kiwmi_server *server);
 
 #endif /* KIWMI_LUAK_LUAK_H */
@@ -9,6 +9,7 @@
 #define KIWMI_SERVER_H
 
 #include <stdbool.h>
+#include <sys/types.h>
 
 #include "desktop/desktop.h"
 #include "input/input.h"
@@ -17,6 +18,7 @@ struct kiwmi_server {
     struct wl_display *wl_display;
     struct wl_event_loop *wl_event_loop;
     struct wlr_backend *backend;
+    struct wlr_backend *headless_backend; // for outputs created at runtime
     struct wlr_renderer *renderer;
     struct wlr_allocator *allocator;
 
@@ -26,13 +28,34 @@ struct kiwmi_server {
     struct kiwmi_desktop desktop;
     struct kiwmi_input input;
 
+    struct wl_list event_streams; // struct kiwmi_event_stream::link
+    size_t ipc_resources; // kiwmi_ipc, kiwmi_command and kiwmi_event_stream
+
+    // Only children spawned by kiwmi are reaped, independent of the Lua
+    // state, so none of them is left behind when a reload fails.
+    struct wl_list children; // struct kiwmi_server_child::link
+    struct wl_event_source *sigchld;
+
     struct {
         struct wl_signal destroy;
+        struct wl_signal child_exit;
     } events;
 };
 
+struct kiwmi_server_child {
+    struct wl_list link;
+    pid_t pid;
+};
+
+struct kiwmi_child_exit_event {
+    pid_t pid;
+    int status; // as returned by waitpid()
+};
+
 bool server_init(struct kiwmi_server *server, char *config_path);
 bool server_run(struct kiwmi_server *server);
 void server_fini(struct kiwmi_server *server);
+// Runs command with /bin/sh, returns the pid or -1.
+pid_t server_spawn(struct kiwmi_server *server, const char *command);
 
 #endif /* KIWMI_SERVER_H */
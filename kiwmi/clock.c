@@ -0,0 +1,22 @@
+/* Copyright (c), Niclas Meyer <niclas@countingsort.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include "clock.h"
+
+uint64_t
+clock_now_nsec(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return timespec_to_nsec(&now);
+}
+
+uint64_t
+timespec_to_nsec(const struct timespec *ts)
+{
+    return (uint64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
@@ -17,6 +17,7 @@
 #include <wlr/types/wlr_export_dmabuf_v1.h>
 #include <wlr/types/wlr_layer_shell_v1.h>
 #include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_output_management_v1.h>
 #include <wlr/types/wlr_presentation_time.h>
 #include <wlr/types/wlr_xdg_decoration_v1.h>
 #include <wlr/types/wlr_xdg_output_v1.h>
@@ -26,7 +27,9 @@
 #include "desktop/desktop_surface.h"
 #include "desktop/layer_shell.h"
 #include "desktop/output.h"
+#include "desktop/output_management.h"
 #include "desktop/stratum.h"
+#include "desktop/transaction.h"
 #include "desktop/view.h"
 #include "desktop/xdg_shell.h"
 #include "input/cursor.h"
@@ -95,14 +98,36 @@ desktop_init(struct kiwmi_desktop *desktop)
     wl_list_init(&desktop->outputs);
     wl_list_init(&desktop->views);
 
+    desktop->occluded_frame_interval = KIWMI_OCCLUDED_FRAME_INTERVAL_DEFAULT;
+
+    desktop->transaction_depth   = 0;
+    desktop->transaction         = NULL;
+    desktop->pending_transaction = NULL;
+
     desktop->new_output.notify = new_output_notify;
     wl_signal_add(&server->backend->events.new_output, &desktop->new_output);
 
+    desktop->output_change_timer = wl_event_loop_add_timer(
+        server->wl_event_loop, output_change_timer_notify, desktop);
+    if (!desktop->output_change_timer) {
+        wlr_log(WLR_ERROR, "failed to create output change timer");
+        return false;
+    }
+
     desktop->output_layout_change.notify = output_layout_change_notify;
     wl_signal_add(
         &desktop->output_layout->events.change, &desktop->output_layout_change);
 
+    desktop->output_manager = wlr_output_manager_v1_create(server->wl_display);
+    desktop->output_manager_apply.notify = output_manager_apply_notify;
+    wl_signal_add(
+        &desktop->output_manager->events.apply, &desktop->output_manager_apply);
+    desktop->output_manager_test.notify = output_manager_test_notify;
+    wl_signal_add(
+        &desktop->output_manager->events.test, &desktop->output_manager_test);
+
     wl_signal_init(&desktop->events.new_output);
+    wl_signal_init(&desktop->events.outputs_change);
     wl_signal_init(&desktop->events.view_map);
     wl_signal_init(&desktop->events.request_active_output);
 
@@ -112,6 +137,15 @@ desktop_init(struct kiwmi_desktop *desktop)
 void
 desktop_fini(struct kiwmi_desktop *desktop)
 {
+    transaction_fini(desktop);
+
+    wl_event_source_remove(desktop->output_change_timer);
+    desktop->output_change_timer = NULL;
+    if (desktop->output_change_idle) {
+        wl_event_source_remove(desktop->output_change_idle);
+        desktop->output_change_idle = NULL;
+    }
+
     wlr_output_layout_destroy(desktop->output_layout);
     desktop->output_layout = NULL;
     wlr_scene_node_destroy(&desktop->scene->node);
@@ -19,6 +19,7 @@
 #include "desktop/output.h"
 #include "desktop/stratum.h"
 #include "input/seat.h"
+#include "luak/ipc.h"
 #include "server.h"
 
 static void
@@ -351,6 +352,8 @@ arrange_layers(struct kiwmi_output *output)
         != 0) {
         memcpy(&output->usable_area, &usable_area, sizeof(output->usable_area));
         wl_signal_emit(&output->events.usable_area_change, output);
+        luaK_ipc_output_event(
+            output, KIWMI_EVENT_STREAM_TYPE_OUTPUT_USABLE_AREA);
     }
 
     struct kiwmi_desktop *desktop = output->desktop;
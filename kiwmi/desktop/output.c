@@ -8,6 +8,7 @@
 #include "desktop/output.h"
 
 #include <stdlib.h>
+#include <time.h>
 
 #include <pixman.h>
 #include <wayland-server.h>
@@ -17,38 +18,396 @@
 #include <wlr/types/wlr_layer_shell_v1.h>
 #include <wlr/types/wlr_matrix.h>
 #include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_output_damage.h>
 #include <wlr/types/wlr_output_layout.h>
 #include <wlr/types/wlr_scene.h>
 #include <wlr/types/wlr_surface.h>
 #include <wlr/types/wlr_xcursor_manager.h>
 #include <wlr/util/log.h>
 
+#include "clock.h"
 #include "desktop/desktop.h"
 #include "desktop/layer_shell.h"
+#include "desktop/output_management.h"
 #include "desktop/view.h"
 #include "input/cursor.h"
 #include "input/input.h"
 #include "input/pointer.h"
+#include "luak/gc.h"
+#include "luak/ipc.h"
 #include "server.h"
 
+static bool
+output_needs_commit(
+    struct kiwmi_output *output,
+    struct wlr_scene_output *scene_output)
+{
+    if (!output->wlr_output->enabled) {
+        return false;
+    }
+
+    return output->needs_frame || output->wlr_output->needs_frame
+        || pixman_region32_not_empty(&scene_output->damage->current);
+}
+
+static void
+frame_stats_record_commit(
+    struct kiwmi_frame_stats *stats,
+    uint64_t frame_nsec,
+    uint64_t start_nsec,
+    uint64_t end_nsec)
+{
+    struct kiwmi_frame_sample *sample = &stats->samples[stats->head];
+
+    sample->frame_to_commit_nsec = start_nsec - frame_nsec;
+    sample->commit_nsec          = end_nsec - start_nsec;
+    sample->present_nsec         = 0;
+
+    stats->head = (stats->head + 1) % KIWMI_FRAME_STATS_SAMPLES;
+    if (stats->count < KIWMI_FRAME_STATS_SAMPLES) {
+        ++stats->count;
+    }
+
+    size_t bucket = 0;
+    while (bucket < KIWMI_FRAME_STATS_BUCKETS - 1
+           && sample->commit_nsec >= output_frame_stats_bucket_limit(bucket)) {
+        ++bucket;
+    }
+    ++stats->histogram[bucket];
+
+    ++stats->frames;
+    stats->last_commit_end_nsec = end_nsec;
+    stats->awaiting_present     = true;
+}
+
+struct frame_done_state {
+    struct kiwmi_output *output;
+    struct timespec now;
+    bool send_occluded;
+    // opaque area of everything above the current node (layout coordinates)
+    pixman_region32_t opaque;
+};
+
+static void
+frame_done_add_opaque(
+    struct frame_done_state *state,
+    struct wlr_surface *surface,
+    int lx,
+    int ly)
+{
+    if (!pixman_region32_not_empty(&surface->opaque_region)) {
+        return;
+    }
+
+    pixman_region32_t opaque;
+    pixman_region32_init(&opaque);
+    pixman_region32_copy(&opaque, &surface->opaque_region);
+    pixman_region32_intersect_rect(
+        &opaque,
+        &opaque,
+        0,
+        0,
+        surface->current.width,
+        surface->current.height);
+    pixman_region32_translate(&opaque, lx, ly);
+    pixman_region32_union(&state->opaque, &state->opaque, &opaque);
+    pixman_region32_fini(&opaque);
+}
+
+// Walks the scene from the topmost node down, the same way wlroots does for
+// wlr_scene_output_send_frame_done(), but skips surfaces which are completely
+// covered by opaque surfaces above them.
+static void
+frame_done_iterate(
+    struct frame_done_state *state,
+    struct wlr_scene_node *node,
+    int lx,
+    int ly)
+{
+    if (!node->state.enabled) {
+        return;
+    }
+
+    lx += node->state.x;
+    ly += node->state.y;
+
+    struct wlr_scene_node *child;
+    wl_list_for_each_reverse (child, &node->state.children, state.link) {
+        frame_done_iterate(state, child, lx, ly);
+    }
+
+    if (node->type != WLR_SCENE_NODE_SURFACE) {
+        return;
+    }
+
+    struct wlr_scene_surface *scene_surface = wlr_scene_surface_from_node(node);
+    struct wlr_surface *surface             = scene_surface->surface;
+
+    if (scene_surface->primary_output == state->output->wlr_output) {
+        pixman_box32_t box = {
+            .x1 = lx,
+            .y1 = ly,
+            .x2 = lx + surface->current.width,
+            .y2 = ly + surface->current.height,
+        };
+
+        bool occluded = box.x2 > box.x1 && box.y2 > box.y1
+            && pixman_region32_contains_rectangle(&state->opaque, &box)
+                == PIXMAN_REGION_IN;
+
+        if (!occluded || state->send_occluded) {
+            wlr_surface_send_frame_done(surface, &state->now);
+        } else {
+            ++state->output->frame_stats.occluded_callbacks;
+        }
+    }
+
+    frame_done_add_opaque(state, surface, lx, ly);
+}
+
+static void
+output_send_frame_done(struct kiwmi_output *output)
+{
+    struct kiwmi_desktop *desktop = output->desktop;
+
+    struct frame_done_state state = {
+        .output = output,
+    };
+    clock_gettime(CLOCK_MONOTONIC, &state.now);
+
+    uint64_t now_nsec = timespec_to_nsec(&state.now);
+    int interval      = desktop->occluded_frame_interval;
+    if (interval > 0
+        && now_nsec - output->occluded_frame_done_nsec
+            >= (uint64_t)interval * 1000000) {
+        state.send_occluded              = true;
+        output->occluded_frame_done_nsec = now_nsec;
+    }
+
+    pixman_region32_init(&state.opaque);
+    frame_done_iterate(&state, &desktop->scene->node, 0, 0);
+    pixman_region32_fini(&state.opaque);
+}
+
+// Stages the adaptive sync state "auto" asks for, so it goes out with the
+// next frame instead of needing a commit of its own.
+static bool
+output_stage_adaptive_sync(
+    struct kiwmi_output *output,
+    struct wlr_scene_output *scene_output)
+{
+    if (output->adaptive_sync != KIWMI_ADAPTIVE_SYNC_AUTO) {
+        return false;
+    }
+
+    struct wlr_output *wlr_output = output->wlr_output;
+
+    bool wanted  = output->latency_sensitive_views > 0;
+    bool enabled = wlr_output->adaptive_sync_status
+        == WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED;
+    if (enabled == wanted || (wanted && output->adaptive_sync_failed)) {
+        return false;
+    }
+
+    wlr_output_enable_adaptive_sync(wlr_output, wanted);
+
+    // Without damage the commit, and the staged state with it, would be
+    // rolled back.
+    wlr_output_damage_add_whole(scene_output->damage);
+
+    return true;
+}
+
+static void
+output_repaint(struct kiwmi_output *output)
+{
+    struct wlr_scene_output *scene_output =
+        wlr_scene_get_scene_output(output->desktop->scene, output->wlr_output);
+
+    if (!scene_output) {
+        return;
+    }
+
+    // Only commit if something on the output actually changed. Otherwise
+    // wlroots would still acquire and attach a buffer just to roll it back.
+    if (output_needs_commit(output, scene_output)) {
+        uint64_t start_nsec = clock_now_nsec();
+
+        bool adaptive_sync_staged =
+            output_stage_adaptive_sync(output, scene_output);
+        bool committed = wlr_scene_output_commit(scene_output);
+
+        // Staging damaged the whole output, so this was a real commit.
+        bool vrr = output->wlr_output->adaptive_sync_status
+            == WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED;
+        if (adaptive_sync_staged
+            && (!committed || vrr != (output->latency_sensitive_views > 0))) {
+            wlr_log(
+                WLR_ERROR,
+                "Failed to %s adaptive sync on %s",
+                vrr ? "disable" : "enable",
+                output->wlr_output->name);
+            output->adaptive_sync_failed = true;
+        }
+
+        if (committed) {
+            output->needs_frame = false;
+
+            if (vrr) {
+                ++output->frame_stats.vrr_frames;
+            } else {
+                ++output->frame_stats.vsync_frames;
+            }
+
+            frame_stats_record_commit(
+                &output->frame_stats,
+                output->frame_nsec,
+                start_nsec,
+                clock_now_nsec());
+
+            struct kiwmi_server *server =
+                wl_container_of(output->desktop, server, desktop);
+            luaK_gc_schedule(server->lua);
+        }
+    } else {
+        ++output->frame_stats.skipped;
+    }
+
+    output_send_frame_done(output);
+}
+
+static int
+output_repaint_timer_notify(void *data)
+{
+    struct kiwmi_output *output = data;
+
+    output->repaint_pending = false;
+    output_repaint(output);
+
+    return 0;
+}
+
+static int
+output_repaint_delay(struct kiwmi_output *output)
+{
+    int max_render_time = output_max_render_time(output);
+    if (max_render_time <= 0 || output->refresh_nsec <= 0
+        || output->last_present_nsec == 0) {
+        return 0;
+    }
+
+    // Predict the next vblank from the last presentation.
+    uint64_t now_nsec  = clock_now_nsec();
+    uint64_t next_nsec = output->last_present_nsec + output->refresh_nsec;
+    if (next_nsec < now_nsec) {
+        uint64_t behind = now_nsec - next_nsec;
+        next_nsec += (behind / output->refresh_nsec + 1) * output->refresh_nsec;
+    }
+
+    int64_t delay_ms =
+        (int64_t)((next_nsec - now_nsec) / 1000000) - max_render_time;
+
+    // wl_event_source_timer_update() treats 0 as disarm
+    if (delay_ms < 1) {
+        return 0;
+    }
+
+    // A presentation clock other than CLOCK_MONOTONIC can put the predicted
+    // vblank arbitrarily far away, never wait longer than one refresh cycle.
+    int64_t refresh_ms = output->refresh_nsec / 1000000;
+    if (delay_ms > refresh_ms) {
+        return refresh_ms;
+    }
+
+    return delay_ms;
+}
+
+static bool
+output_apply_adaptive_sync(struct kiwmi_output *output, bool enabled)
+{
+    struct wlr_output *wlr_output = output->wlr_output;
+
+    wlr_output_enable_adaptive_sync(wlr_output, enabled);
+    if (!wlr_output_commit(wlr_output)) {
+        wlr_log(
+            WLR_ERROR,
+            "Failed to %s adaptive sync on %s",
+            enabled ? "enable" : "disable",
+            wlr_output->name);
+        output->adaptive_sync_failed = true;
+        return false;
+    }
+
+    bool is_enabled =
+        wlr_output->adaptive_sync_status == WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED;
+    if (is_enabled != enabled) {
+        output->adaptive_sync_failed = true;
+        return false;
+    }
+
+    return true;
+}
+
 static void
 output_frame_notify(struct wl_listener *listener, void *data)
 {
     struct kiwmi_output *output   = wl_container_of(listener, output, frame);
     struct wlr_output *wlr_output = data;
 
+    if (output->repaint_pending) {
+        return;
+    }
+
+    output->frame_nsec = clock_now_nsec();
+
+    // Let the config react to the pointer before this frame is rendered.
+    struct kiwmi_server *server =
+        wl_container_of(output->desktop, server, desktop);
+    cursor_flush_motion(server->input.cursor);
+
     struct wlr_scene_output *scene_output =
         wlr_scene_get_scene_output(output->desktop->scene, wlr_output);
 
-    if (!scene_output) {
+    // Nothing to render, so there is no point in waiting for the deadline.
+    if (!scene_output || !output_needs_commit(output, scene_output)) {
+        output_repaint(output);
         return;
     }
 
-    wlr_scene_output_commit(scene_output);
+    // Latency sensitive clients get their frame as soon as possible.
+    if (output->latency_sensitive_views > 0) {
+        ++output->frame_stats.immediate_frames;
+        output_repaint(output);
+        return;
+    }
 
-    struct timespec now;
-    clock_gettime(CLOCK_MONOTONIC, &now);
-    wlr_scene_output_send_frame_done(scene_output, &now);
+    // Delay rendering until just before the next vblank, so that input
+    // arriving in the meantime still makes it into this frame.
+    int delay = output_repaint_delay(output);
+    if (delay > 0) {
+        ++output->frame_stats.deadline_frames;
+        output->repaint_pending = true;
+        wl_event_source_timer_update(output->repaint_timer, delay);
+        return;
+    }
+
+    output_repaint(output);
+}
+
+static void
+output_arrange_now(struct kiwmi_output *output)
+{
+    arrange_layers(output);
+
+    wl_signal_emit(&output->events.resize, output);
+}
+
+static void
+output_arrange(struct kiwmi_output *output)
+{
+    // Defer, a hotplug usually comes with a burst of mode and layout changes.
+    output->arrange_pending = true;
+    output_change_schedule(output->desktop);
 }
 
 static void
@@ -57,10 +416,54 @@ output_commit_notify(struct wl_listener *listener, void *data)
     struct kiwmi_output *output = wl_container_of(listener, output, commit);
     struct wlr_output_event_commit *event = data;
 
-    if (event->committed & WLR_OUTPUT_STATE_TRANSFORM) {
-        arrange_layers(output);
+    uint32_t needs_frame = WLR_OUTPUT_STATE_ENABLED | WLR_OUTPUT_STATE_MODE
+        | WLR_OUTPUT_STATE_SCALE | WLR_OUTPUT_STATE_TRANSFORM;
+    if (event->committed & needs_frame) {
+        output_schedule_frame(output);
+    }
+
+    if (event->committed
+        & (WLR_OUTPUT_STATE_TRANSFORM | WLR_OUTPUT_STATE_SCALE)) {
+        output_arrange(output);
+    }
+}
+
+static void
+output_present_notify(struct wl_listener *listener, void *data)
+{
+    struct kiwmi_output *output = wl_container_of(listener, output, present);
+    struct wlr_output_event_present *event = data;
+    struct kiwmi_frame_stats *stats        = &output->frame_stats;
+
+    if (!event->when) {
+        return;
+    }
 
-        wl_signal_emit(&output->events.resize, output);
+    output->last_present_nsec = timespec_to_nsec(event->when);
+    output->refresh_nsec      = event->refresh;
+
+    if (!stats->awaiting_present) {
+        return;
+    }
+
+    stats->awaiting_present = false;
+
+    uint64_t when_nsec = output->last_present_nsec;
+    if (when_nsec < stats->last_commit_end_nsec) {
+        // presentation clock isn't CLOCK_MONOTONIC
+        return;
+    }
+
+    uint64_t latency = when_nsec - stats->last_commit_end_nsec;
+
+    size_t last = (stats->head + KIWMI_FRAME_STATS_SAMPLES - 1)
+        % KIWMI_FRAME_STATS_SAMPLES;
+    stats->samples[last].present_nsec = latency;
+
+    // Anything presented more than one refresh cycle after the commit
+    // missed at least one vblank.
+    if (event->refresh > 0) {
+        stats->missed_vblanks += latency / event->refresh;
     }
 }
 
@@ -70,6 +473,7 @@ output_destroy_notify(struct wl_listener *listener, void *UNUSED(data))
     struct kiwmi_output *output = wl_container_of(listener, output, destroy);
 
     wl_signal_emit(&output->events.destroy, output);
+    luaK_ipc_output_event(output, KIWMI_EVENT_STREAM_TYPE_OUTPUT_DESTROY);
 
     int n_layers = sizeof(output->layers) / sizeof(output->layers[0]);
     for (int i = 0; i < n_layers; i++) {
@@ -90,16 +494,28 @@ output_destroy_notify(struct wl_listener *listener, void *UNUSED(data))
         }
     }
 
+    struct kiwmi_view *view;
+    wl_list_for_each (view, &output->desktop->views, link) {
+        if (view->covered_output == output) {
+            view->covered_output = NULL;
+        }
+    }
+
+    // Unlink first, the layout change must not see this output anymore.
+    wl_list_remove(&output->link);
+
     if (output->desktop->output_layout) {
         wlr_output_layout_remove(
             output->desktop->output_layout, output->wlr_output);
     }
 
-    wl_list_remove(&output->link);
     wl_list_remove(&output->frame.link);
     wl_list_remove(&output->commit.link);
     wl_list_remove(&output->destroy.link);
     wl_list_remove(&output->mode.link);
+    wl_list_remove(&output->present.link);
+
+    wl_event_source_remove(output->repaint_timer);
 
     wl_list_remove(&output->events.destroy.listener_list);
 
@@ -111,21 +527,29 @@ output_mode_notify(struct wl_listener *listener, void *UNUSED(data))
 {
     struct kiwmi_output *output = wl_container_of(listener, output, mode);
 
-    arrange_layers(output);
-
-    wl_signal_emit(&output->events.resize, output);
+    output_arrange(output);
 }
 
 static struct kiwmi_output *
 output_create(struct wlr_output *wlr_output, struct kiwmi_desktop *desktop)
 {
+    struct kiwmi_server *server = wl_container_of(desktop, server, desktop);
+
     struct kiwmi_output *output = calloc(1, sizeof(*output));
     if (!output) {
         return NULL;
     }
 
-    output->wlr_output = wlr_output;
-    output->desktop    = desktop;
+    output->repaint_timer = wl_event_loop_add_timer(
+        server->wl_event_loop, output_repaint_timer_notify, output);
+    if (!output->repaint_timer) {
+        free(output);
+        return NULL;
+    }
+
+    output->wlr_output  = wlr_output;
+    output->desktop     = desktop;
+    output->needs_frame = true;
 
     output->usable_area.width  = wlr_output->width;
     output->usable_area.height = wlr_output->height;
@@ -142,6 +566,9 @@ output_create(struct wlr_output *wlr_output, struct kiwmi_desktop *desktop)
     output->mode.notify = output_mode_notify;
     wl_signal_add(&wlr_output->events.mode, &output->mode);
 
+    output->present.notify = output_present_notify;
+    wl_signal_add(&wlr_output->events.present, &output->present);
+
     return output;
 }
 
@@ -187,10 +614,6 @@ new_output_notify(struct wl_listener *listener, void *data)
         }
     }
 
-    wl_list_insert(&desktop->outputs, &output->link);
-
-    wlr_output_layout_add_auto(desktop->output_layout, wlr_output);
-
     wlr_output_create_global(wlr_output);
 
     size_t len_layers = sizeof(output->layers) / sizeof(output->layers[0]);
@@ -211,14 +634,96 @@ new_output_notify(struct wl_listener *listener, void *data)
     wlr_output_layout_add_auto(desktop->output_layout, wlr_output);
 
     wl_signal_emit(&desktop->events.new_output, output);
+    luaK_ipc_output_event(output, KIWMI_EVENT_STREAM_TYPE_OUTPUT_NEW);
 }
 
 void
-output_layout_change_notify(struct wl_listener *listener, void *UNUSED(data))
+output_schedule_frame(struct kiwmi_output *output)
 {
-    struct kiwmi_desktop *desktop =
-        wl_container_of(listener, desktop, output_layout_change);
+    output->needs_frame = true;
+
+    // wlr_scene_output_commit() rolls back commits without any damage.
+    struct wlr_scene_output *scene_output =
+        wlr_scene_get_scene_output(output->desktop->scene, output->wlr_output);
+    if (scene_output) {
+        wlr_output_damage_add_whole(scene_output->damage);
+    }
+
+    wlr_output_schedule_frame(output->wlr_output);
+}
+
+int
+output_max_render_time(struct kiwmi_output *output)
+{
+    if (output->max_render_time != KIWMI_MAX_RENDER_TIME_AUTO) {
+        return output->max_render_time;
+    }
+
+    struct kiwmi_frame_stats *stats = &output->frame_stats;
+
+    // Learn the commit cost from the most recent frames.
+    size_t window = stats->count < KIWMI_MAX_RENDER_TIME_WINDOW
+        ? stats->count
+        : KIWMI_MAX_RENDER_TIME_WINDOW;
+    if (window == 0) {
+        return 0;
+    }
+
+    uint64_t max_nsec = 0;
+    for (size_t i = 1; i <= window; ++i) {
+        size_t index = (stats->head + KIWMI_FRAME_STATS_SAMPLES - i)
+            % KIWMI_FRAME_STATS_SAMPLES;
+        if (stats->samples[index].commit_nsec > max_nsec) {
+            max_nsec = stats->samples[index].commit_nsec;
+        }
+    }
+
+    // round up and leave a safety margin of one millisecond
+    return (max_nsec + 999999) / 1000000 + 1;
+}
+
+bool
+output_set_adaptive_sync(
+    struct kiwmi_output *output,
+    enum kiwmi_adaptive_sync adaptive_sync)
+{
+    output->adaptive_sync        = adaptive_sync;
+    output->adaptive_sync_failed = false;
+
+    switch (adaptive_sync) {
+    case KIWMI_ADAPTIVE_SYNC_OFF:
+        return output_apply_adaptive_sync(output, false);
+    case KIWMI_ADAPTIVE_SYNC_ON:
+        return output_apply_adaptive_sync(output, true);
+    case KIWMI_ADAPTIVE_SYNC_AUTO:
+        // decided on the next frame
+        output_schedule_frame(output);
+        return true;
+    }
+
+    return false;
+}
+
+void
+output_update_latency_sensitive_views(struct kiwmi_output *output, int delta)
+{
+    output->latency_sensitive_views += delta;
+
+    // Switches adaptive sync with the next frame.
+    if (output->adaptive_sync == KIWMI_ADAPTIVE_SYNC_AUTO) {
+        output_schedule_frame(output);
+    }
+}
+
+uint64_t
+output_frame_stats_bucket_limit(size_t bucket)
+{
+    return (uint64_t)250000 << bucket;
+}
 
+static void
+output_layout_update(struct kiwmi_desktop *desktop)
+{
     struct wlr_box *ol_box =
         wlr_output_layout_get_box(desktop->output_layout, NULL);
     wlr_scene_node_set_position(
@@ -240,4 +745,122 @@ output_layout_change_notify(struct wl_listener *listener, void *UNUSED(data))
             }
         }
     }
+
+    // Views stay where they are, but may cover different outputs now.
+    struct kiwmi_view *view;
+    wl_list_for_each (view, &desktop->views, link) {
+        view_update_latency_sensitive(view);
+    }
+
+    output_manager_update(desktop);
+}
+
+void
+output_layout_change_notify(struct wl_listener *listener, void *UNUSED(data))
+{
+    struct kiwmi_desktop *desktop =
+        wl_container_of(listener, desktop, output_layout_change);
+
+    desktop->output_layout_dirty = true;
+    output_change_schedule(desktop);
+}
+
+void
+output_batch_begin(struct kiwmi_desktop *desktop)
+{
+    ++desktop->output_batch_depth;
+}
+
+void
+output_batch_end(struct kiwmi_desktop *desktop)
+{
+    if (--desktop->output_batch_depth > 0) {
+        return;
+    }
+
+    if (desktop->output_layout_dirty) {
+        desktop->output_layout_dirty = false;
+        output_layout_update(desktop);
+    }
+
+    struct kiwmi_output *output;
+    struct kiwmi_output *tmp;
+    wl_list_for_each_safe (output, tmp, &desktop->outputs, link) {
+        if (output->arrange_pending) {
+            output->arrange_pending = false;
+            output_arrange_now(output);
+        }
+    }
+}
+
+static void
+output_change_idle_notify(void *data)
+{
+    struct kiwmi_desktop *desktop = data;
+
+    // The idle source is removed by the event loop after this returns.
+    desktop->output_change_idle = NULL;
+    output_change_flush(desktop);
+}
+
+int
+output_change_timer_notify(void *data)
+{
+    struct kiwmi_desktop *desktop = data;
+
+    output_change_flush(desktop);
+
+    return 0;
+}
+
+void
+output_change_schedule(struct kiwmi_desktop *desktop)
+{
+    // Shutting down
+    if (!desktop->output_change_timer) {
+        return;
+    }
+
+    if (!desktop->output_change_pending) {
+        desktop->output_change_pending = true;
+        output_batch_begin(desktop);
+    }
+
+    if (desktop->output_debounce > 0) {
+        // Every change restarts the window.
+        wl_event_source_timer_update(
+            desktop->output_change_timer, desktop->output_debounce);
+        return;
+    }
+
+    if (!desktop->output_change_idle) {
+        struct kiwmi_server *server =
+            wl_container_of(desktop, server, desktop);
+
+        desktop->output_change_idle = wl_event_loop_add_idle(
+            server->wl_event_loop, output_change_idle_notify, desktop);
+        if (!desktop->output_change_idle) {
+            output_change_flush(desktop);
+        }
+    }
+}
+
+void
+output_change_flush(struct kiwmi_desktop *desktop)
+{
+    if (!desktop->output_change_pending) {
+        return;
+    }
+
+    desktop->output_change_pending = false;
+
+    wl_event_source_timer_update(desktop->output_change_timer, 0);
+    if (desktop->output_change_idle) {
+        wl_event_source_remove(desktop->output_change_idle);
+        desktop->output_change_idle = NULL;
+    }
+
+    output_batch_end(desktop);
+
+    wl_signal_emit(&desktop->events.outputs_change, desktop);
 }
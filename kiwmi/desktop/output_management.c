@@ -0,0 +1,268 @@
+/* Copyright (c), Niclas Meyer <niclas@countingsort.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include "desktop/output_management.h"
+
+#include <stdlib.h>
+
+#include <wayland-server.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_output_management_v1.h>
+#include <wlr/util/box.h>
+#include <wlr/util/log.h>
+
+#include "desktop/desktop.h"
+#include "desktop/output.h"
+
+static struct wlr_output_mode *
+output_config_find_mode(struct kiwmi_output_config *config)
+{
+    struct wlr_output *wlr_output = config->output->wlr_output;
+
+    struct wlr_output_mode *best = NULL;
+    struct wlr_output_mode *mode;
+    wl_list_for_each (mode, &wlr_output->modes, link) {
+        if (mode->width != config->width || mode->height != config->height) {
+            continue;
+        }
+
+        if (!best) {
+            best = mode;
+            continue;
+        }
+
+        if (config->refresh == 0) {
+            if (mode->refresh > best->refresh) {
+                best = mode;
+            }
+        } else if (
+            abs(mode->refresh - config->refresh)
+            < abs(best->refresh - config->refresh)) {
+            best = mode;
+        }
+    }
+
+    // Don't silently pick a completely different refresh rate.
+    if (best && config->refresh != 0
+        && abs(best->refresh - config->refresh) > 1000) {
+        return NULL;
+    }
+
+    return best;
+}
+
+static void
+output_config_stage(struct kiwmi_output_config *config)
+{
+    struct wlr_output *wlr_output = config->output->wlr_output;
+
+    wlr_output_enable(wlr_output, config->enabled);
+    if (!config->enabled) {
+        return;
+    }
+
+    struct wlr_output_mode *mode = config->mode;
+    if (!mode && config->width > 0 && config->height > 0) {
+        mode = output_config_find_mode(config);
+        if (!mode) {
+            wlr_output_set_custom_mode(
+                wlr_output, config->width, config->height, config->refresh);
+        }
+    }
+
+    if (mode) {
+        wlr_output_set_mode(wlr_output, mode);
+    }
+
+    if (config->scale > 0) {
+        wlr_output_set_scale(wlr_output, config->scale);
+    }
+
+    if (config->has_transform) {
+        wlr_output_set_transform(wlr_output, config->transform);
+    }
+}
+
+bool
+output_config_apply(
+    struct kiwmi_desktop *desktop,
+    struct kiwmi_output_config *configs,
+    size_t count,
+    bool test_only)
+{
+    // Test every output first, so nothing is touched if one of them fails.
+    bool ok = true;
+    for (size_t i = 0; i < count; ++i) {
+        struct wlr_output *wlr_output = configs[i].output->wlr_output;
+
+        output_config_stage(&configs[i]);
+
+        if (!wlr_output_test(wlr_output)) {
+            wlr_log(
+                WLR_ERROR,
+                "Output configuration for %s rejected",
+                wlr_output->name);
+            ok = false;
+            break;
+        }
+    }
+
+    if (!ok || test_only) {
+        for (size_t i = 0; i < count; ++i) {
+            wlr_output_rollback(configs[i].output->wlr_output);
+        }
+
+        return ok;
+    }
+
+    output_batch_begin(desktop);
+
+    for (size_t i = 0; i < count; ++i) {
+        struct kiwmi_output_config *config = &configs[i];
+        struct wlr_output *wlr_output      = config->output->wlr_output;
+
+        if (!wlr_output_commit(wlr_output)) {
+            wlr_log(
+                WLR_ERROR,
+                "Failed to commit output configuration for %s",
+                wlr_output->name);
+            ok = false;
+            continue;
+        }
+
+        if (!config->enabled) {
+            wlr_output_layout_remove(desktop->output_layout, wlr_output);
+        } else if (config->has_position) {
+            wlr_output_layout_add(
+                desktop->output_layout, wlr_output, config->x, config->y);
+        } else if (!wlr_output_layout_get(desktop->output_layout, wlr_output)) {
+            wlr_output_layout_add_auto(desktop->output_layout, wlr_output);
+        }
+    }
+
+    output_batch_end(desktop);
+
+    // Apply right away instead of waiting for the next idle.
+    output_change_flush(desktop);
+
+    return ok;
+}
+
+void
+output_manager_update(struct kiwmi_desktop *desktop)
+{
+    if (!desktop->output_manager) {
+        return;
+    }
+
+    struct wlr_output_configuration_v1 *config =
+        wlr_output_configuration_v1_create();
+    if (!config) {
+        return;
+    }
+
+    struct kiwmi_output *output;
+    wl_list_for_each (output, &desktop->outputs, link) {
+        struct wlr_output_configuration_head_v1 *head =
+            wlr_output_configuration_head_v1_create(config, output->wlr_output);
+        if (!head) {
+            wlr_output_configuration_v1_destroy(config);
+            return;
+        }
+
+        struct wlr_box *box = wlr_output_layout_get_box(
+            desktop->output_layout, output->wlr_output);
+        if (box) {
+            head->state.x = box->x;
+            head->state.y = box->y;
+        }
+    }
+
+    wlr_output_manager_v1_set_configuration(desktop->output_manager, config);
+}
+
+static bool
+output_manager_apply(
+    struct kiwmi_desktop *desktop,
+    struct wlr_output_configuration_v1 *config,
+    bool test_only)
+{
+    size_t count = wl_list_length(&config->heads);
+
+    struct kiwmi_output_config *configs = calloc(count, sizeof(*configs));
+    if (count > 0 && !configs) {
+        return false;
+    }
+
+    size_t i = 0;
+    struct wlr_output_configuration_head_v1 *head;
+    wl_list_for_each (head, &config->heads, link) {
+        struct kiwmi_output *output = head->state.output->data;
+        if (!output) {
+            continue;
+        }
+
+        struct kiwmi_output_config *output_config = &configs[i++];
+
+        output_config->output  = output;
+        output_config->enabled = head->state.enabled;
+        output_config->mode    = head->state.mode;
+        if (!head->state.mode) {
+            output_config->width   = head->state.custom_mode.width;
+            output_config->height  = head->state.custom_mode.height;
+            output_config->refresh = head->state.custom_mode.refresh;
+        }
+        output_config->has_position  = true;
+        output_config->x             = head->state.x;
+        output_config->y             = head->state.y;
+        output_config->scale         = head->state.scale;
+        output_config->has_transform = true;
+        output_config->transform     = head->state.transform;
+    }
+
+    bool ok = output_config_apply(desktop, configs, i, test_only);
+
+    free(configs);
+
+    return ok;
+}
+
+void
+output_manager_apply_notify(struct wl_listener *listener, void *data)
+{
+    struct kiwmi_desktop *desktop =
+        wl_container_of(listener, desktop, output_manager_apply);
+    struct wlr_output_configuration_v1 *config = data;
+
+    if (output_manager_apply(desktop, config, false)) {
+        wlr_output_configuration_v1_send_succeeded(config);
+    } else {
+        wlr_output_configuration_v1_send_failed(config);
+    }
+
+    wlr_output_configuration_v1_destroy(config);
+
+    // Make sure clients see the actual state even after a partial failure.
+    output_manager_update(desktop);
+}
+
+void
+output_manager_test_notify(struct wl_listener *listener, void *data)
+{
+    struct kiwmi_desktop *desktop =
+        wl_container_of(listener, desktop, output_manager_test);
+    struct wlr_output_configuration_v1 *config = data;
+
+    if (output_manager_apply(desktop, config, true)) {
+        wlr_output_configuration_v1_send_succeeded(config);
+    } else {
+        wlr_output_configuration_v1_send_failed(config);
+    }
+
+    wlr_output_configuration_v1_destroy(config);
+}
@@ -0,0 +1,324 @@
+/* Copyright (c), Niclas Meyer <niclas@countingsort.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include "desktop/transaction.h"
+
+#include <stdlib.h>
+
+#include <wayland-server.h>
+#include <wlr/util/log.h>
+
+#include "desktop/desktop.h"
+#include "desktop/view.h"
+#include "input/cursor.h"
+#include "input/input.h"
+#include "server.h"
+
+static struct kiwmi_transaction *
+transaction_create(struct kiwmi_desktop *desktop)
+{
+    struct kiwmi_transaction *transaction = malloc(sizeof(*transaction));
+    if (!transaction) {
+        wlr_log(WLR_ERROR, "Failed to allocate kiwmi_transaction");
+        return NULL;
+    }
+
+    transaction->desktop = desktop;
+    transaction->waiting = 0;
+    transaction->timer   = NULL;
+    wl_list_init(&transaction->instructions);
+
+    return transaction;
+}
+
+static void
+transaction_destroy(struct kiwmi_transaction *transaction)
+{
+    if (transaction->timer) {
+        wl_event_source_remove(transaction->timer);
+    }
+
+    struct kiwmi_transaction_instruction *instruction;
+    struct kiwmi_transaction_instruction *tmp;
+    wl_list_for_each_safe (
+        instruction,
+        tmp,
+        &transaction->instructions,
+        link) {
+        wl_list_remove(&instruction->link);
+        free(instruction);
+    }
+
+    free(transaction);
+}
+
+static struct kiwmi_transaction_instruction *
+transaction_find(
+    struct kiwmi_transaction *transaction,
+    struct kiwmi_view *view)
+{
+    struct kiwmi_transaction_instruction *instruction;
+    wl_list_for_each (instruction, &transaction->instructions, link) {
+        if (instruction->view == view) {
+            return instruction;
+        }
+    }
+
+    return NULL;
+}
+
+static void
+transaction_apply(struct kiwmi_transaction *transaction)
+{
+    struct kiwmi_desktop *desktop = transaction->desktop;
+    struct kiwmi_server *server = wl_container_of(desktop, server, desktop);
+
+    if (desktop->pending_transaction == transaction) {
+        desktop->pending_transaction = NULL;
+    }
+
+    struct kiwmi_transaction_instruction *instruction;
+    wl_list_for_each (instruction, &transaction->instructions, link) {
+        if (instruction->has_pos) {
+            view_move_nodes(instruction->view, instruction->x, instruction->y);
+        }
+    }
+
+    transaction_destroy(transaction);
+
+    // Once for all views instead of once per move.
+    cursor_schedule_refresh_focus(server->input.cursor);
+}
+
+static int
+transaction_timer_notify(void *data)
+{
+    struct kiwmi_transaction *transaction = data;
+
+    wlr_log(
+        WLR_DEBUG,
+        "Transaction timed out with %zu clients left",
+        transaction->waiting);
+
+    transaction_apply(transaction);
+
+    return 0;
+}
+
+void
+transaction_begin(struct kiwmi_desktop *desktop)
+{
+    if (desktop->transaction_depth++ > 0) {
+        return;
+    }
+
+    // Only one transaction waits for clients at a time.
+    if (desktop->pending_transaction) {
+        transaction_apply(desktop->pending_transaction);
+    }
+
+    desktop->transaction = transaction_create(desktop);
+}
+
+void
+transaction_commit(struct kiwmi_desktop *desktop)
+{
+    if (--desktop->transaction_depth > 0) {
+        return;
+    }
+
+    struct kiwmi_transaction *transaction = desktop->transaction;
+    desktop->transaction                  = NULL;
+
+    if (!transaction) {
+        return;
+    }
+
+    struct kiwmi_transaction_instruction *instruction;
+    wl_list_for_each (instruction, &transaction->instructions, link) {
+        struct kiwmi_view *view = instruction->view;
+
+        if (instruction->has_size) {
+            instruction->serial = view_configure_size(
+                view, instruction->width, instruction->height);
+        }
+
+        // Unmapped clients don't commit in response to a configure.
+        instruction->ready = instruction->serial == 0 || !view->mapped;
+        if (!instruction->ready) {
+            ++transaction->waiting;
+        }
+    }
+
+    if (transaction->waiting == 0) {
+        transaction_apply(transaction);
+        return;
+    }
+
+    struct kiwmi_server *server = wl_container_of(desktop, server, desktop);
+
+    transaction->timer = wl_event_loop_add_timer(
+        server->wl_event_loop, transaction_timer_notify, transaction);
+    if (!transaction->timer
+        || wl_event_source_timer_update(
+               transaction->timer, KIWMI_TRANSACTION_TIMEOUT)
+            < 0) {
+        wlr_log(WLR_ERROR, "Failed to arm transaction timer");
+        transaction_apply(transaction);
+        return;
+    }
+
+    desktop->pending_transaction = transaction;
+}
+
+void
+transaction_fini(struct kiwmi_desktop *desktop)
+{
+    if (desktop->transaction) {
+        transaction_destroy(desktop->transaction);
+        desktop->transaction = NULL;
+    }
+
+    if (desktop->pending_transaction) {
+        transaction_destroy(desktop->pending_transaction);
+        desktop->pending_transaction = NULL;
+    }
+}
+
+static void
+transaction_remove_view(
+    struct kiwmi_transaction *transaction,
+    struct kiwmi_view *view)
+{
+    struct kiwmi_transaction_instruction *instruction =
+        transaction_find(transaction, view);
+    if (!instruction) {
+        return;
+    }
+
+    wl_list_remove(&instruction->link);
+    bool ready = instruction->ready;
+    free(instruction);
+
+    // Views of a transaction that is still being recorded never wait.
+    if (!ready && transaction->waiting > 0 && --transaction->waiting == 0) {
+        transaction_apply(transaction);
+    }
+}
+
+static struct kiwmi_transaction_instruction *
+transaction_record(struct kiwmi_view *view)
+{
+    struct kiwmi_transaction *transaction = view->desktop->transaction;
+    if (!transaction) {
+        return NULL;
+    }
+
+    struct kiwmi_transaction_instruction *instruction =
+        transaction_find(transaction, view);
+    if (instruction) {
+        return instruction;
+    }
+
+    instruction = calloc(1, sizeof(*instruction));
+    if (!instruction) {
+        wlr_log(WLR_ERROR, "Failed to allocate transaction instruction");
+        return NULL;
+    }
+
+    instruction->view = view;
+    wl_list_insert(transaction->instructions.prev, &instruction->link);
+
+    return instruction;
+}
+
+bool
+transaction_record_pos(struct kiwmi_view *view, uint32_t x, uint32_t y)
+{
+    struct kiwmi_transaction_instruction *instruction =
+        transaction_record(view);
+    if (!instruction) {
+        // The view moves right away, a transaction still waiting for clients
+        // mustn't move it back later.
+        struct kiwmi_transaction *pending = view->desktop->pending_transaction;
+        if (pending && (instruction = transaction_find(pending, view))) {
+            instruction->has_pos = false;
+        }
+
+        return false;
+    }
+
+    instruction->has_pos = true;
+    instruction->x       = x;
+    instruction->y       = y;
+
+    return true;
+}
+
+bool
+transaction_record_size(
+    struct kiwmi_view *view,
+    uint32_t width,
+    uint32_t height)
+{
+    struct kiwmi_transaction_instruction *instruction =
+        transaction_record(view);
+    if (!instruction) {
+        // The new configure replaces the one the transaction waits for.
+        if (view->desktop->pending_transaction) {
+            transaction_remove_view(view->desktop->pending_transaction, view);
+        }
+
+        return false;
+    }
+
+    instruction->has_size = true;
+    instruction->width    = width;
+    instruction->height   = height;
+
+    return true;
+}
+
+void
+transaction_view_ack(struct kiwmi_view *view, uint32_t serial)
+{
+    struct kiwmi_transaction *transaction =
+        view->desktop->pending_transaction;
+    if (!transaction) {
+        return;
+    }
+
+    struct kiwmi_transaction_instruction *instruction =
+        transaction_find(transaction, view);
+    if (!instruction || instruction->ready) {
+        return;
+    }
+
+    // serials wrap around
+    if ((int32_t)(serial - instruction->serial) < 0) {
+        return;
+    }
+
+    instruction->ready = true;
+    if (--transaction->waiting == 0) {
+        transaction_apply(transaction);
+    }
+}
+
+void
+transaction_view_destroy(struct kiwmi_view *view)
+{
+    struct kiwmi_desktop *desktop = view->desktop;
+
+    if (desktop->transaction) {
+        transaction_remove_view(desktop->transaction, view);
+    }
+
+    if (desktop->pending_transaction) {
+        transaction_remove_view(desktop->pending_transaction, view);
+    }
+}
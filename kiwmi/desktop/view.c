@@ -8,11 +8,13 @@
 #include "desktop/view.h"
 
 #include <wlr/types/wlr_cursor.h>
+#include <wlr/types/wlr_output_layout.h>
 #include <wlr/types/wlr_scene.h>
 #include <wlr/util/log.h>
 
 #include "desktop/output.h"
 #include "desktop/stratum.h"
+#include "desktop/transaction.h"
 #include "input/cursor.h"
 #include "input/seat.h"
 #include "server.h"
@@ -70,26 +72,54 @@ view_set_activated(struct kiwmi_view *view, bool activated)
     }
 }
 
+uint32_t
+view_configure_size(struct kiwmi_view *view, uint32_t width, uint32_t height)
+{
+    if (view->impl->set_size) {
+        return view->impl->set_size(view, width, height);
+    }
+
+    return 0;
+}
+
 void
 view_set_size(struct kiwmi_view *view, uint32_t width, uint32_t height)
 {
-    if (view->impl->set_size) {
-        view->impl->set_size(view, width, height);
+    output_change_flush(view->desktop);
+
+    if (transaction_record_size(view, width, height)) {
+        return;
     }
+
+    view_configure_size(view, width, height);
 }
 
 void
-view_set_pos(struct kiwmi_view *view, uint32_t x, uint32_t y)
+view_move_nodes(struct kiwmi_view *view, uint32_t x, uint32_t y)
 {
     wlr_scene_node_set_position(&view->desktop_surface.tree->node, x, y);
     wlr_scene_node_set_position(&view->desktop_surface.popups_tree->node, x, y);
 
+    view_update_latency_sensitive(view);
+}
+
+void
+view_set_pos(struct kiwmi_view *view, uint32_t x, uint32_t y)
+{
+    output_change_flush(view->desktop);
+
+    if (transaction_record_pos(view, x, y)) {
+        return;
+    }
+
+    view_move_nodes(view, x, y);
+
     int lx, ly; // unused
     // If it is enabled (as well as all its parents)
     if (wlr_scene_node_coords(&view->desktop_surface.tree->node, &lx, &ly)) {
         struct kiwmi_server *server =
             wl_container_of(view->desktop, server, desktop);
-        cursor_refresh_focus(server->input.cursor, NULL, NULL, NULL);
+        cursor_schedule_refresh_focus(server->input.cursor);
     }
 }
 
@@ -112,6 +142,8 @@ view_set_hidden(struct kiwmi_view *view, bool hidden)
     wlr_scene_node_set_enabled(
         &view->desktop_surface.popups_tree->node, !hidden);
 
+    view_update_latency_sensitive(view);
+
     struct kiwmi_server *server =
         wl_container_of(view->desktop, server, desktop);
     struct kiwmi_seat *seat = server->input.seat;
@@ -120,6 +152,56 @@ view_set_hidden(struct kiwmi_view *view, bool hidden)
     }
 }
 
+static struct kiwmi_output *
+view_covered_output(struct kiwmi_view *view)
+{
+    if (!view->mapped || !view->latency_sensitive) {
+        return NULL;
+    }
+
+    int lx, ly;
+    // hidden views don't cover anything
+    if (!wlr_scene_node_coords(&view->desktop_surface.tree->node, &lx, &ly)) {
+        return NULL;
+    }
+
+    struct kiwmi_output *output;
+    wl_list_for_each (output, &view->desktop->outputs, link) {
+        struct wlr_box *box = wlr_output_layout_get_box(
+            view->desktop->output_layout, output->wlr_output);
+        if (!box) {
+            continue;
+        }
+
+        if (lx <= box->x && ly <= box->y
+            && lx + view->geom.width >= box->x + box->width
+            && ly + view->geom.height >= box->y + box->height) {
+            return output;
+        }
+    }
+
+    return NULL;
+}
+
+void
+view_update_latency_sensitive(struct kiwmi_view *view)
+{
+    struct kiwmi_output *output = view_covered_output(view);
+    if (output == view->covered_output) {
+        return;
+    }
+
+    if (view->covered_output) {
+        output_update_latency_sensitive_views(view->covered_output, -1);
+    }
+
+    if (output) {
+        output_update_latency_sensitive_views(output, 1);
+    }
+
+    view->covered_output = output;
+}
+
 struct kiwmi_view *
 view_at(struct kiwmi_desktop *desktop, double lx, double ly)
 {
@@ -233,11 +315,13 @@ view_create(
         return NULL;
     }
 
-    view->desktop    = desktop;
-    view->type       = type;
-    view->impl       = impl;
-    view->mapped     = false;
-    view->decoration = NULL;
+    view->desktop           = desktop;
+    view->type              = type;
+    view->impl              = impl;
+    view->mapped            = false;
+    view->latency_sensitive = false;
+    view->covered_output    = NULL;
+    view->decoration        = NULL;
 
     view->desktop_surface.type = KIWMI_DESKTOP_SURFACE_VIEW;
     view->desktop_surface.impl = &view_desktop_surface_impl;
@@ -20,10 +20,12 @@
 #include "desktop/desktop.h"
 #include "desktop/output.h"
 #include "desktop/popup.h"
+#include "desktop/transaction.h"
 #include "desktop/view.h"
 #include "input/cursor.h"
 #include "input/input.h"
 #include "input/seat.h"
+#include "luak/ipc.h"
 #include "server.h"
 
 static void
@@ -32,7 +34,13 @@ xdg_surface_map_notify(struct wl_listener *listener, void *UNUSED(data))
     struct kiwmi_view *view = wl_container_of(listener, view, map);
     view->mapped            = true;
 
+    // The config places the view, so let it see the current outputs.
+    output_change_flush(view->desktop);
+
     wl_signal_emit(&view->desktop->events.view_map, view);
+    luaK_ipc_view_event(view, KIWMI_EVENT_STREAM_TYPE_VIEW_MAP);
+
+    view_update_latency_sensitive(view);
 }
 
 static void
@@ -42,6 +50,8 @@ xdg_surface_unmap_notify(struct wl_listener *listener, void *UNUSED(data))
 
     view->mapped = false;
 
+    view_update_latency_sensitive(view);
+
     int lx, ly; // unused
     if (wlr_scene_node_coords(&view->desktop_surface.tree->node, &lx, &ly)) {
         wlr_scene_node_set_enabled(&view->desktop_surface.tree->node, false);
@@ -50,7 +60,7 @@ xdg_surface_unmap_notify(struct wl_listener *listener, void *UNUSED(data))
 
         struct kiwmi_server *server =
             wl_container_of(view->desktop, server, desktop);
-        cursor_refresh_focus(server->input.cursor, NULL, NULL, NULL);
+        cursor_schedule_refresh_focus(server->input.cursor);
 
         struct kiwmi_seat *seat = server->input.seat;
         if (seat->focused_view == view) {
@@ -59,6 +69,7 @@ xdg_surface_unmap_notify(struct wl_listener *listener, void *UNUSED(data))
     }
 
     wl_signal_emit(&view->events.unmap, view);
+    luaK_ipc_view_event(view, KIWMI_EVENT_STREAM_TYPE_VIEW_UNMAP);
 }
 
 static void
@@ -66,15 +77,19 @@ xdg_surface_commit_notify(struct wl_listener *listener, void *UNUSED(data))
 {
     struct kiwmi_view *view = wl_container_of(listener, view, commit);
 
+    transaction_view_ack(view, view->xdg_surface->current.configure_serial);
+
     struct wlr_box geom;
     wlr_xdg_surface_get_geometry(view->xdg_surface, &geom);
 
     if (memcmp(&view->geom, &geom, sizeof(geom)) != 0) {
         memcpy(&view->geom, &geom, sizeof(geom));
 
+        view_update_latency_sensitive(view);
+
         struct kiwmi_desktop *desktop = view->desktop;
         struct kiwmi_server *server = wl_container_of(desktop, server, desktop);
-        cursor_refresh_focus(server->input.cursor, NULL, NULL, NULL);
+        cursor_schedule_refresh_focus(server->input.cursor);
     }
 }
 
@@ -83,6 +98,8 @@ xdg_surface_destroy_notify(struct wl_listener *listener, void *UNUSED(data))
 {
     struct kiwmi_view *view = wl_container_of(listener, view, destroy);
 
+    transaction_view_destroy(view);
+
     wlr_scene_node_destroy(&view->desktop_surface.tree->node);
     wlr_scene_node_destroy(&view->desktop_surface.popups_tree->node);
 
@@ -97,6 +114,7 @@ xdg_surface_destroy_notify(struct wl_listener *listener, void *UNUSED(data))
     wl_list_remove(&view->destroy.link);
     wl_list_remove(&view->request_move.link);
     wl_list_remove(&view->request_resize.link);
+    wl_list_remove(&view->set_title.link);
 
     wl_list_remove(&view->events.unmap.listener_list);
 
@@ -137,6 +155,16 @@ xdg_shell_view_close(struct kiwmi_view *view)
     }
 }
 
+static void
+xdg_toplevel_set_title_notify(struct wl_listener *listener, void *UNUSED(data))
+{
+    struct kiwmi_view *view = wl_container_of(listener, view, set_title);
+
+    if (view->mapped) {
+        luaK_ipc_view_event(view, KIWMI_EVENT_STREAM_TYPE_VIEW_TITLE);
+    }
+}
+
 static pid_t
 xdg_shell_view_get_pid(struct kiwmi_view *view)
 {
@@ -169,13 +197,13 @@ xdg_shell_view_set_activated(struct kiwmi_view *view, bool activated)
     wlr_xdg_toplevel_set_activated(view->xdg_surface, activated);
 }
 
-static void
+static uint32_t
 xdg_shell_view_set_size(
     struct kiwmi_view *view,
     uint32_t width,
     uint32_t height)
 {
-    wlr_xdg_toplevel_set_size(view->xdg_surface, width, height);
+    return wlr_xdg_toplevel_set_size(view->xdg_surface, width, height);
 }
 
 static void
@@ -209,7 +237,7 @@ xdg_shell_new_surface_notify(struct wl_listener *listener, void *data)
 
             struct kiwmi_server *server =
                 wl_container_of(desktop, server, desktop);
-            cursor_refresh_focus(server->input.cursor, NULL, NULL, NULL);
+            cursor_schedule_refresh_focus(server->input.cursor);
         }
         return;
     }
@@ -256,6 +284,9 @@ xdg_shell_new_surface_notify(struct wl_listener *listener, void *data)
     wl_signal_add(
         &xdg_surface->toplevel->events.request_resize, &view->request_resize);
 
+    view->set_title.notify = xdg_toplevel_set_title_notify;
+    wl_signal_add(&xdg_surface->toplevel->events.set_title, &view->set_title);
+
     wlr_xdg_surface_get_geometry(view->xdg_surface, &view->geom);
 
     wl_list_insert(&desktop->views, &view->link);
@@ -0,0 +1,143 @@
+/* Copyright (c), Niclas Meyer <niclas@countingsort.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include "hashmap.h"
+
+#include <stdlib.h>
+
+#define HASHMAP_MIN_CAPACITY 16
+
+static uint64_t
+hash(uint64_t key)
+{
+    // splitmix64 finalizer, pointers and keysyms have few random low bits
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111eb;
+    key ^= key >> 31;
+    return key;
+}
+
+static struct kiwmi_hashmap_entry *
+hashmap_find(struct kiwmi_hashmap *map, uint64_t key)
+{
+    size_t mask = map->capacity - 1;
+
+    for (size_t i = hash(key) & mask;; i = (i + 1) & mask) {
+        struct kiwmi_hashmap_entry *entry = &map->entries[i];
+        if (!entry->value || entry->key == key) {
+            return entry;
+        }
+    }
+}
+
+static bool
+hashmap_grow(struct kiwmi_hashmap *map)
+{
+    size_t capacity = map->capacity ? map->capacity * 2 : HASHMAP_MIN_CAPACITY;
+
+    struct kiwmi_hashmap_entry *entries = calloc(capacity, sizeof(*entries));
+    if (!entries) {
+        return false;
+    }
+
+    struct kiwmi_hashmap old = *map;
+
+    map->entries  = entries;
+    map->capacity = capacity;
+
+    for (size_t i = 0; i < old.capacity; ++i) {
+        if (old.entries[i].value) {
+            *hashmap_find(map, old.entries[i].key) = old.entries[i];
+        }
+    }
+
+    free(old.entries);
+
+    return true;
+}
+
+void
+hashmap_init(struct kiwmi_hashmap *map)
+{
+    map->entries  = NULL;
+    map->capacity = 0;
+    map->len      = 0;
+}
+
+void
+hashmap_fini(struct kiwmi_hashmap *map)
+{
+    free(map->entries);
+    hashmap_init(map);
+}
+
+void *
+hashmap_get(struct kiwmi_hashmap *map, uint64_t key)
+{
+    if (map->len == 0) {
+        return NULL;
+    }
+
+    return hashmap_find(map, key)->value;
+}
+
+bool
+hashmap_insert(struct kiwmi_hashmap *map, uint64_t key, void *value)
+{
+    // keep the load factor below 3/4
+    if ((map->len + 1) * 4 > map->capacity * 3 && !hashmap_grow(map)) {
+        return false;
+    }
+
+    struct kiwmi_hashmap_entry *entry = hashmap_find(map, key);
+    if (!entry->value) {
+        ++map->len;
+    }
+
+    entry->key   = key;
+    entry->value = value;
+
+    return true;
+}
+
+void *
+hashmap_remove(struct kiwmi_hashmap *map, uint64_t key)
+{
+    if (map->len == 0) {
+        return NULL;
+    }
+
+    struct kiwmi_hashmap_entry *entry = hashmap_find(map, key);
+    void *value                       = entry->value;
+    if (!value) {
+        return NULL;
+    }
+
+    --map->len;
+
+    // Shift the following entries back instead of leaving a tombstone.
+    size_t mask = map->capacity - 1;
+    size_t hole = entry - map->entries;
+    for (size_t i = (hole + 1) & mask; map->entries[i].value;
+         i = (i + 1) & mask) {
+        size_t home = hash(map->entries[i].key) & mask;
+
+        // Move the entry unless its home lies cyclically in (hole, i].
+        bool stays = hole <= i ? (hole < home && home <= i)
+                               : (hole < home || home <= i);
+        if (!stays) {
+            map->entries[hole] = map->entries[i];
+            hole               = i;
+        }
+    }
+
+    map->entries[hole].value = NULL;
+
+    return value;
+}
@@ -12,6 +12,7 @@
 #include <wayland-server.h>
 #include <wlr/types/wlr_cursor.h>
 #include <wlr/types/wlr_layer_shell_v1.h>
+#include <wlr/types/wlr_output.h>
 #include <wlr/types/wlr_output_layout.h>
 #include <wlr/types/wlr_pointer.h>
 #include <wlr/types/wlr_scene.h>
@@ -96,6 +97,32 @@ process_cursor_motion(struct kiwmi_server *server, uint32_t time)
     }
 }
 
+static void
+cursor_coalesce_motion(
+    struct kiwmi_cursor *cursor,
+    struct kiwmi_cursor_motion_event *event)
+{
+    if (wl_list_empty(&cursor->events.motion_coalesced.listener_list)) {
+        return;
+    }
+
+    if (cursor->coalesced_motion.pending) {
+        return;
+    }
+
+    cursor->coalesced_motion.pending = true;
+    cursor->coalesced_motion.oldx    = event->oldx;
+    cursor->coalesced_motion.oldy    = event->oldy;
+
+    // A hardware cursor doesn't damage the output, make sure there is a
+    // frame to deliver the motion with.
+    struct wlr_output *output = wlr_output_layout_output_at(
+        cursor->server->desktop.output_layout, event->newx, event->newy);
+    if (output) {
+        wlr_output_schedule_frame(output);
+    }
+}
+
 static void
 cursor_motion_notify(struct wl_listener *listener, void *data)
 {
@@ -116,6 +143,7 @@ cursor_motion_notify(struct wl_listener *listener, void *data)
     new_event.newy = cursor->cursor->y;
 
     wl_signal_emit(&cursor->events.motion, &new_event);
+    cursor_coalesce_motion(cursor, &new_event);
 
     process_cursor_motion(server, event->time_msec);
 }
@@ -139,6 +167,7 @@ cursor_motion_absolute_notify(struct wl_listener *listener, void *data)
     new_event.newy = cursor->cursor->y;
 
     wl_signal_emit(&cursor->events.motion, &new_event);
+    cursor_coalesce_motion(cursor, &new_event);
 
     process_cursor_motion(server, event->time_msec);
 }
@@ -222,8 +251,13 @@ cursor_create(
         return NULL;
     }
 
-    cursor->server      = server;
-    cursor->cursor_mode = KIWMI_CURSOR_PASSTHROUGH;
+    cursor->server                   = server;
+    cursor->cursor_mode              = KIWMI_CURSOR_PASSTHROUGH;
+    cursor->coalesced_motion.pending = false;
+    cursor->focus_dirty              = false;
+    cursor->focus_idle               = NULL;
+    cursor->focus_stats.refreshes    = 0;
+    cursor->focus_stats.avoided      = 0;
 
     cursor->cursor = wlr_cursor_create();
     if (!cursor->cursor) {
@@ -257,16 +291,40 @@ cursor_create(
     wl_signal_init(&cursor->events.button_up);
     wl_signal_init(&cursor->events.destroy);
     wl_signal_init(&cursor->events.motion);
+    wl_signal_init(&cursor->events.motion_coalesced);
     wl_signal_init(&cursor->events.scroll);
 
     return cursor;
 }
 
+void
+cursor_flush_motion(struct kiwmi_cursor *cursor)
+{
+    if (!cursor->coalesced_motion.pending) {
+        return;
+    }
+
+    cursor->coalesced_motion.pending = false;
+
+    struct kiwmi_cursor_motion_event event = {
+        .oldx = cursor->coalesced_motion.oldx,
+        .oldy = cursor->coalesced_motion.oldy,
+        .newx = cursor->cursor->x,
+        .newy = cursor->cursor->y,
+    };
+
+    wl_signal_emit(&cursor->events.motion_coalesced, &event);
+}
+
 void
 cursor_destroy(struct kiwmi_cursor *cursor)
 {
     wl_signal_emit(&cursor->events.destroy, cursor);
 
+    if (cursor->focus_idle) {
+        wl_event_source_remove(cursor->focus_idle);
+    }
+
     wlr_cursor_destroy(cursor->cursor);
     wlr_xcursor_manager_destroy(cursor->xcursor_manager);
 
@@ -275,6 +333,41 @@ cursor_destroy(struct kiwmi_cursor *cursor)
     free(cursor);
 }
 
+static void
+cursor_focus_idle_notify(void *data)
+{
+    struct kiwmi_cursor *cursor = data;
+
+    // idle sources are removed after they fired
+    cursor->focus_idle = NULL;
+
+    if (cursor->focus_dirty) {
+        cursor->focus_dirty = false;
+        cursor_refresh_focus(cursor, NULL, NULL, NULL);
+    }
+}
+
+void
+cursor_schedule_refresh_focus(struct kiwmi_cursor *cursor)
+{
+    if (cursor->focus_dirty) {
+        ++cursor->focus_stats.avoided;
+        return;
+    }
+
+    cursor->focus_dirty = true;
+
+    if (!cursor->focus_idle) {
+        cursor->focus_idle = wl_event_loop_add_idle(
+            cursor->server->wl_event_loop, cursor_focus_idle_notify, cursor);
+    }
+
+    if (!cursor->focus_idle) {
+        cursor->focus_dirty = false;
+        cursor_refresh_focus(cursor, NULL, NULL, NULL);
+    }
+}
+
 void
 cursor_refresh_focus(
     struct kiwmi_cursor *cursor,
@@ -289,6 +382,13 @@ cursor_refresh_focus(
     double sx;
     double sy;
 
+    // This also covers a deferred refresh.
+    if (cursor->focus_dirty) {
+        cursor->focus_dirty = false;
+        ++cursor->focus_stats.avoided;
+    }
+    ++cursor->focus_stats.refreshes;
+
     struct wlr_scene_node *node_at = wlr_scene_node_at(
         &desktop->scene->node, cursor->cursor->x, cursor->cursor->y, &sx, &sy);
 
@@ -96,6 +96,8 @@ input_init(struct kiwmi_input *input)
     wl_list_init(&input->keyboards);
     wl_list_init(&input->pointers);
 
+    hashmap_init(&input->keybinds);
+
     input->new_input.notify = new_input_notify;
     wl_signal_add(&server->backend->events.new_input, &input->new_input);
 
@@ -113,6 +115,8 @@ input_fini(struct kiwmi_input *input)
         keyboard_destroy(keyboard);
     }
 
+    keybinds_clear(&input->keybinds);
+
     struct kiwmi_pointer *pointer;
     struct kiwmi_pointer *tmp_pointer;
     wl_list_for_each_safe (pointer, tmp_pointer, &input->pointers, link) {
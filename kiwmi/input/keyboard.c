@@ -9,18 +9,41 @@
 
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
+#include <strings.h>
 
 #include <wayland-server.h>
 #include <wlr/backend.h>
 #include <wlr/backend/multi.h>
 #include <wlr/types/wlr_input_device.h>
+#include <wlr/types/wlr_keyboard.h>
 #include <wlr/types/wlr_seat.h>
 #include <wlr/util/log.h>
 #include <xkbcommon/xkbcommon.h>
 
+#include "input/input.h"
 #include "input/seat.h"
 #include "server.h"
 
+// Lock modifiers shouldn't change which keybind matches.
+#define KEYBIND_IGNORED_MODIFIERS (WLR_MODIFIER_CAPS | WLR_MODIFIER_MOD2)
+
+static const struct {
+    const char *name;
+    uint32_t modifier;
+} keybind_modifiers[] = {
+    {"shift", WLR_MODIFIER_SHIFT},
+    {"ctrl", WLR_MODIFIER_CTRL},
+    {"control", WLR_MODIFIER_CTRL},
+    {"alt", WLR_MODIFIER_ALT},
+    {"mod1", WLR_MODIFIER_ALT},
+    {"mod3", WLR_MODIFIER_MOD3},
+    {"super", WLR_MODIFIER_LOGO},
+    {"logo", WLR_MODIFIER_LOGO},
+    {"mod4", WLR_MODIFIER_LOGO},
+    {"mod5", WLR_MODIFIER_MOD5},
+};
+
 static bool
 switch_vt(const xkb_keysym_t *syms, int nsyms, struct wlr_backend *backend)
 {
@@ -42,6 +65,106 @@ switch_vt(const xkb_keysym_t *syms, int nsyms, struct wlr_backend *backend)
     return false;
 }
 
+// Translates the xkb modifiers consumed by key into wlr modifiers.
+static uint32_t
+keyboard_consumed_modifiers(struct wlr_keyboard *keyboard, uint32_t keycode)
+{
+    xkb_mod_mask_t consumed = xkb_state_key_get_consumed_mods2(
+        keyboard->xkb_state, keycode, XKB_CONSUMED_MODE_XKB);
+
+    uint32_t modifiers = 0;
+    for (size_t i = 0; i < WLR_MODIFIER_COUNT; ++i) {
+        xkb_mod_index_t index = keyboard->mod_indexes[i];
+        if (index != XKB_MOD_INVALID && (consumed & (1u << index))) {
+            modifiers |= 1u << i;
+        }
+    }
+
+    return modifiers;
+}
+
+static struct kiwmi_keybind *
+keyboard_find_keybind(
+    struct kiwmi_keyboard *keyboard,
+    uint32_t modifiers,
+    const xkb_keysym_t *syms,
+    int syms_len)
+{
+    struct kiwmi_hashmap *global = &keyboard->server->input.keybinds;
+
+    for (int i = 0; i < syms_len; ++i) {
+        uint64_t key = keybind_key(modifiers, syms[i]);
+
+        struct kiwmi_keybind *keybind = hashmap_get(&keyboard->keybinds, key);
+        if (!keybind) {
+            keybind = hashmap_get(global, key);
+        }
+
+        if (keybind) {
+            return keybind;
+        }
+    }
+
+    return NULL;
+}
+
+static bool
+keyboard_run_keybind(
+    struct kiwmi_keyboard *keyboard,
+    uint32_t keycode,
+    const xkb_keysym_t *translated_syms,
+    int translated_syms_len,
+    const xkb_keysym_t *raw_syms,
+    int raw_syms_len)
+{
+    struct wlr_keyboard *wlr_keyboard = keyboard->device->keyboard;
+
+    if (keyboard->keybinds.len == 0
+        && keyboard->server->input.keybinds.len == 0) {
+        return false;
+    }
+
+    uint32_t modifiers = wlr_keyboard_get_modifiers(wlr_keyboard)
+        & ~KEYBIND_IGNORED_MODIFIERS;
+
+    // Translated keysyms without the modifiers used for the translation
+    // (shift+1 is "exclam"), then the raw ones with all modifiers
+    // (shift+1 is "shift+1").
+    uint32_t consumed = keyboard_consumed_modifiers(wlr_keyboard, keycode);
+    struct kiwmi_keybind *keybind = keyboard_find_keybind(
+        keyboard, modifiers & ~consumed, translated_syms, translated_syms_len);
+    if (!keybind) {
+        keybind =
+            keyboard_find_keybind(keyboard, modifiers, raw_syms, raw_syms_len);
+    }
+
+    if (!keybind) {
+        return false;
+    }
+
+    if (keyboard->bound_keys_len < KIWMI_KEYBOARD_BOUND_KEYS) {
+        keyboard->bound_keys[keyboard->bound_keys_len++] = keycode;
+    }
+
+    keybind->handler(keybind, keyboard);
+
+    return true;
+}
+
+static bool
+keyboard_release_bound_key(struct kiwmi_keyboard *keyboard, uint32_t keycode)
+{
+    for (size_t i = 0; i < keyboard->bound_keys_len; ++i) {
+        if (keyboard->bound_keys[i] == keycode) {
+            keyboard->bound_keys[i] =
+                keyboard->bound_keys[--keyboard->bound_keys_len];
+            return true;
+        }
+    }
+
+    return false;
+}
+
 static void
 keyboard_modifiers_notify(struct wl_listener *listener, void *UNUSED(data))
 {
@@ -78,6 +201,18 @@ keyboard_key_notify(struct wl_listener *listener, void *data)
     if (event->state == WL_KEYBOARD_KEY_STATE_PRESSED) {
         handled =
             switch_vt(translated_syms, translated_syms_len, server->backend);
+
+        if (!handled) {
+            handled = keyboard_run_keybind(
+                keyboard,
+                keycode,
+                translated_syms,
+                translated_syms_len,
+                raw_syms,
+                raw_syms_len);
+        }
+    } else {
+        handled = keyboard_release_bound_key(keyboard, keycode);
     }
 
     if (!handled) {
@@ -129,8 +264,11 @@ keyboard_create(struct kiwmi_server *server, struct wlr_input_device *device)
         return NULL;
     }
 
-    keyboard->server = server;
-    keyboard->device = device;
+    keyboard->server         = server;
+    keyboard->device         = device;
+    keyboard->bound_keys_len = 0;
+
+    hashmap_init(&keyboard->keybinds);
 
     keyboard->modifiers.notify = keyboard_modifiers_notify;
     wl_signal_add(&device->keyboard->events.modifiers, &keyboard->modifiers);
@@ -170,9 +308,103 @@ keyboard_destroy(struct kiwmi_keyboard *keyboard)
 
     wl_signal_emit(&keyboard->events.destroy, keyboard);
 
+    keybinds_clear(&keyboard->keybinds);
+
     wl_list_remove(&keyboard->link);
 
     wl_list_remove(&keyboard->events.destroy.listener_list);
 
     free(keyboard);
 }
+
+uint64_t
+keybind_key(uint32_t modifiers, xkb_keysym_t sym)
+{
+    return (uint64_t)modifiers << 32 | sym;
+}
+
+bool
+keybind_parse(const char *binding, uint32_t *modifiers, xkb_keysym_t *sym)
+{
+    *modifiers = 0;
+
+    const char *part = binding;
+    const char *plus;
+    while ((plus = strchr(part, '+')) && plus[1] != '\0') {
+        size_t len = plus - part;
+
+        bool found = false;
+        size_t len_modifiers =
+            sizeof(keybind_modifiers) / sizeof(keybind_modifiers[0]);
+        for (size_t i = 0; i < len_modifiers; ++i) {
+            if (strlen(keybind_modifiers[i].name) == len
+                && strncasecmp(keybind_modifiers[i].name, part, len) == 0) {
+                *modifiers |= keybind_modifiers[i].modifier;
+                found = true;
+                break;
+            }
+        }
+
+        if (!found) {
+            return false;
+        }
+
+        part = plus + 1;
+    }
+
+    // Prefer the exact name, "A" and "a" are different keysyms.
+    *sym = xkb_keysym_from_name(part, XKB_KEYSYM_NO_FLAGS);
+    if (*sym == XKB_KEY_NoSymbol) {
+        *sym = xkb_keysym_from_name(part, XKB_KEYSYM_CASE_INSENSITIVE);
+    }
+
+    return *sym != XKB_KEY_NoSymbol;
+}
+
+bool
+keybinds_add(struct kiwmi_hashmap *keybinds, struct kiwmi_keybind *keybind)
+{
+    uint64_t key = keybind_key(keybind->modifiers, keybind->sym);
+
+    struct kiwmi_keybind *old = hashmap_get(keybinds, key);
+
+    if (!hashmap_insert(keybinds, key, keybind)) {
+        return false;
+    }
+
+    if (old) {
+        old->destroy(old);
+    }
+
+    return true;
+}
+
+bool
+keybinds_remove(
+    struct kiwmi_hashmap *keybinds,
+    uint32_t modifiers,
+    xkb_keysym_t sym)
+{
+    struct kiwmi_keybind *keybind =
+        hashmap_remove(keybinds, keybind_key(modifiers, sym));
+    if (!keybind) {
+        return false;
+    }
+
+    keybind->destroy(keybind);
+
+    return true;
+}
+
+void
+keybinds_clear(struct kiwmi_hashmap *keybinds)
+{
+    for (size_t i = 0; i < keybinds->capacity; ++i) {
+        struct kiwmi_keybind *keybind = keybinds->entries[i].value;
+        if (keybind) {
+            keybind->destroy(keybind);
+        }
+    }
+
+    hashmap_fini(keybinds);
+}
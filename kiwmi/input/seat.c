@@ -19,6 +19,7 @@
 #include "desktop/layer_shell.h"
 #include "desktop/view.h"
 #include "input/cursor.h"
+#include "luak/ipc.h"
 #include "server.h"
 
 void
@@ -87,11 +88,13 @@ seat_focus_view(struct kiwmi_seat *seat, struct kiwmi_view *view)
     wlr_scene_node_raise_to_top(&view->desktop_surface.tree->node);
     wlr_scene_node_raise_to_top(&view->desktop_surface.popups_tree->node);
 
-    cursor_refresh_focus(seat->input->cursor, NULL, NULL, NULL);
+    cursor_schedule_refresh_focus(seat->input->cursor);
 
     seat->focused_view = view;
     view_set_activated(view, true);
     seat_focus_surface(seat, view->wlr_surface);
+
+    luaK_ipc_view_event(view, KIWMI_EVENT_STREAM_TYPE_VIEW_FOCUS);
 }
 
 static void
@@ -0,0 +1,308 @@
+/* Copyright (c), Niclas Meyer <niclas@countingsort.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include "luak/bytecode.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <lauxlib.h>
+#include <wlr/util/log.h>
+
+#include "luak/lua_compat.h"
+
+#define BYTECODE_MAGIC "kiwmi-luac-1"
+
+static bool
+cache_dir(char *buf, size_t size)
+{
+    const char *cache_home = getenv("XDG_CACHE_HOME");
+    const char *home       = getenv("HOME");
+
+    int len;
+    if (cache_home && cache_home[0] != '\0') {
+        len = snprintf(buf, size, "%s", cache_home);
+    } else if (home) {
+        len = snprintf(buf, size, "%s/.cache", home);
+    } else {
+        return false;
+    }
+
+    if (len < 0 || (size_t)len >= size) {
+        return false;
+    }
+
+    if (mkdir(buf, 0700) != 0 && errno != EEXIST) {
+        return false;
+    }
+
+    len = snprintf(buf + len, size - len, "/kiwmi");
+    if (len < 0 || (size_t)len >= size) {
+        return false;
+    }
+
+    // Bytecode isn't verified when loaded, so keep it private.
+    if (mkdir(buf, 0700) != 0 && errno != EEXIST) {
+        return false;
+    }
+
+    return true;
+}
+
+static bool
+cache_file(char *buf, size_t size, const char *path)
+{
+    if (!cache_dir(buf, size)) {
+        return false;
+    }
+
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325;
+    for (const char *c = path; *c; ++c) {
+        hash ^= (unsigned char)*c;
+        hash *= 0x100000001b3;
+    }
+
+    size_t len = strlen(buf);
+    int ret = snprintf(buf + len, size - len, "/%016" PRIx64 ".luac", hash);
+
+    return ret >= 0 && (size_t)ret < size - len;
+}
+
+// The cache entry is only used if its header matches exactly.
+static int
+cache_header(char *buf, size_t size, const char *path, struct stat *st)
+{
+    return snprintf(
+        buf,
+        size,
+        BYTECODE_MAGIC "\n" LUA_RELEASE "\n%lld.%09ld %lld\n%s\n",
+        (long long)st->st_mtim.tv_sec,
+        (long)st->st_mtim.tv_nsec,
+        (long long)st->st_size,
+        path);
+}
+
+static bool
+cache_load(
+    lua_State *L,
+    const char *cache,
+    const char *header,
+    size_t header_len,
+    const char *path)
+{
+    FILE *file = fopen(cache, "rb");
+    if (!file) {
+        return false;
+    }
+
+    char *buf = NULL;
+    long len  = -1;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        len = ftell(file);
+    }
+
+    if (len <= (long)header_len || fseek(file, 0, SEEK_SET) != 0
+        || !(buf = malloc(len)) || fread(buf, 1, len, file) != (size_t)len) {
+        free(buf);
+        fclose(file);
+        return false;
+    }
+
+    fclose(file);
+
+    if (memcmp(buf, header, header_len) != 0) {
+        free(buf);
+        return false;
+    }
+
+    char chunkname[PATH_MAX + 1];
+    snprintf(chunkname, sizeof(chunkname), "@%s", path);
+
+    int status = luaL_loadbuffer(
+        L, buf + header_len, len - header_len, chunkname);
+    free(buf);
+
+    if (status != 0) {
+        // e.g. written by another Lua implementation of the same version
+        wlr_log(
+            WLR_DEBUG,
+            "Ignoring cached bytecode of %s: %s",
+            path,
+            lua_tostring(L, -1));
+        lua_pop(L, 1);
+        return false;
+    }
+
+    return true;
+}
+
+static int
+cache_writer(lua_State *UNUSED(L), const void *p, size_t size, void *data)
+{
+    FILE *file = data;
+    return fwrite(p, 1, size, file) != size;
+}
+
+static void
+cache_store(
+    lua_State *L,
+    const char *cache,
+    const char *header,
+    size_t header_len)
+{
+    char tmp[PATH_MAX];
+    if (snprintf(tmp, sizeof(tmp), "%s.XXXXXX", cache) >= (int)sizeof(tmp)) {
+        return;
+    }
+
+    int fd = mkstemp(tmp);
+    if (fd < 0) {
+        return;
+    }
+
+    FILE *file = fdopen(fd, "wb");
+    if (!file) {
+        close(fd);
+        unlink(tmp);
+        return;
+    }
+
+    bool ok = fwrite(header, 1, header_len, file) == header_len
+        && luaC_dump(L, cache_writer, file) == 0;
+    ok = fclose(file) == 0 && ok;
+
+    // Replace atomically, another kiwmi might be reading it.
+    if (!ok || rename(tmp, cache) != 0) {
+        wlr_log(WLR_DEBUG, "Failed to write bytecode cache %s", cache);
+        unlink(tmp);
+    }
+}
+
+int
+luaK_loadfile_cached(lua_State *L, const char *path)
+{
+    char cache[PATH_MAX];
+    char header[PATH_MAX + 128];
+
+    struct stat st;
+    if (stat(path, &st) != 0 || !cache_file(cache, sizeof(cache), path)) {
+        return luaL_loadfile(L, path);
+    }
+
+    int header_len = cache_header(header, sizeof(header), path, &st);
+    if (header_len < 0 || (size_t)header_len >= sizeof(header)) {
+        return luaL_loadfile(L, path);
+    }
+
+    if (cache_load(L, cache, header, header_len, path)) {
+        return 0;
+    }
+
+    int status = luaL_loadfile(L, path);
+    if (status == 0) {
+        cache_store(L, cache, header, header_len);
+    }
+
+    return status;
+}
+
+// Same lookup as the searcher for Lua files, which is missing
+// package.searchpath() on Lua 5.1.
+static int
+bytecode_searcher(lua_State *L)
+{
+    const char *name = luaL_checkstring(L, 1);
+
+    lua_getglobal(L, "package");
+    lua_getfield(L, -1, "path");
+    const char *templates = lua_tostring(L, -1);
+    if (!templates) {
+        return luaL_error(L, "package.path must be a string");
+    }
+
+    char filename[PATH_MAX];
+    luaL_Buffer tried;
+    luaL_buffinit(L, &tried);
+
+    const char *template = templates;
+    while (*template) {
+        const char *end = strchr(template, ';');
+        if (!end) {
+            end = template + strlen(template);
+        }
+
+        size_t len = 0;
+        for (const char *c = template; c < end && len < sizeof(filename); ++c) {
+            if (*c != '?') {
+                filename[len++] = *c;
+                continue;
+            }
+
+            for (const char *n = name; *n && len < sizeof(filename); ++n) {
+                filename[len++] = *n == '.' ? '/' : *n;
+            }
+        }
+
+        template = *end ? end + 1 : end;
+
+        if (len == 0 || len >= sizeof(filename)) {
+            continue;
+        }
+        filename[len] = '\0';
+
+        if (access(filename, R_OK) != 0) {
+            luaL_addstring(&tried, "\n\tno file '");
+            luaL_addstring(&tried, filename);
+            luaL_addstring(&tried, "'");
+            continue;
+        }
+
+        if (luaK_loadfile_cached(L, filename)) {
+            return luaL_error(
+                L,
+                "error loading module '%s' from file '%s':\n\t%s",
+                name,
+                filename,
+                lua_tostring(L, -1));
+        }
+
+        lua_pushstring(L, filename);
+        return 2;
+    }
+
+    luaL_pushresult(&tried);
+    return 1;
+}
+
+void
+luaK_bytecode_install_searcher(lua_State *L)
+{
+    lua_getglobal(L, "package");
+#if LUA_VERSION_NUM >= 502
+    lua_getfield(L, -1, "searchers");
+#else
+    lua_getfield(L, -1, "loaders");
+#endif
+
+    // The second searcher is the one for Lua files.
+    if (lua_istable(L, -1)) {
+        lua_pushcfunction(L, bytecode_searcher);
+        lua_rawseti(L, -2, 2);
+    }
+
+    lua_pop(L, 2);
+}
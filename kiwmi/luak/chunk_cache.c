@@ -0,0 +1,142 @@
+/* Copyright (c), Niclas Meyer <niclas@countingsort.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include "luak/chunk_cache.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <lauxlib.h>
+#include <wlr/util/log.h>
+
+#include "luak/luak.h"
+
+struct kiwmi_chunk {
+    struct wl_list link;
+    uint64_t hash;
+    char *source; // to tell hash collisions apart
+    int function_ref;
+};
+
+static uint64_t
+chunk_hash(const char *source)
+{
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325;
+    for (const char *c = source; *c; ++c) {
+        hash ^= (unsigned char)*c;
+        hash *= 0x100000001b3;
+    }
+
+    return hash;
+}
+
+static void
+chunk_destroy(
+    struct kiwmi_lua *lua,
+    struct kiwmi_chunk_cache *cache,
+    struct kiwmi_chunk *chunk)
+{
+    hashmap_remove(&cache->chunks, chunk->hash);
+    wl_list_remove(&chunk->link);
+    --cache->len;
+
+    luaL_unref(lua->L, LUA_REGISTRYINDEX, chunk->function_ref);
+
+    free(chunk->source);
+    free(chunk);
+}
+
+void
+luaK_chunk_cache_init(struct kiwmi_chunk_cache *cache)
+{
+    hashmap_init(&cache->chunks);
+    wl_list_init(&cache->lru);
+    cache->len = 0;
+
+    cache->stats.hits      = 0;
+    cache->stats.misses    = 0;
+    cache->stats.evictions = 0;
+}
+
+void
+luaK_chunk_cache_fini(struct kiwmi_chunk_cache *cache)
+{
+    struct kiwmi_chunk *chunk;
+    struct kiwmi_chunk *tmp;
+    wl_list_for_each_safe (chunk, tmp, &cache->lru, link) {
+        free(chunk->source);
+        free(chunk);
+    }
+
+    hashmap_fini(&cache->chunks);
+    wl_list_init(&cache->lru);
+    cache->len = 0;
+}
+
+int
+luaK_chunk_cache_load(struct kiwmi_lua *lua, const char *source)
+{
+    struct kiwmi_chunk_cache *cache = &lua->chunk_cache;
+    lua_State *L                    = lua->L;
+
+    uint64_t hash             = chunk_hash(source);
+    struct kiwmi_chunk *chunk = hashmap_get(&cache->chunks, hash);
+
+    if (chunk && strcmp(chunk->source, source) == 0) {
+        ++cache->stats.hits;
+
+        wl_list_remove(&chunk->link);
+        wl_list_insert(&cache->lru, &chunk->link);
+
+        lua_rawgeti(L, LUA_REGISTRYINDEX, chunk->function_ref);
+        return 0;
+    }
+
+    ++cache->stats.misses;
+
+    int error = luaL_loadstring(L, source);
+    if (error || strlen(source) > KIWMI_CHUNK_CACHE_MAX_SOURCE) {
+        return error;
+    }
+
+    // Only one chunk per hash, the newer one wins.
+    if (chunk) {
+        chunk_destroy(lua, cache, chunk);
+    }
+
+    if (cache->len >= KIWMI_CHUNK_CACHE_CAPACITY) {
+        struct kiwmi_chunk *oldest =
+            wl_container_of(cache->lru.prev, oldest, link);
+        chunk_destroy(lua, cache, oldest);
+        ++cache->stats.evictions;
+    }
+
+    chunk = malloc(sizeof(*chunk));
+    if (!chunk) {
+        wlr_log(WLR_ERROR, "Failed to allocate kiwmi_chunk");
+        return 0;
+    }
+
+    chunk->source = strdup(source);
+    if (!chunk->source || !hashmap_insert(&cache->chunks, hash, chunk)) {
+        wlr_log(WLR_ERROR, "Failed to cache chunk");
+        free(chunk->source);
+        free(chunk);
+        return 0;
+    }
+
+    chunk->hash = hash;
+
+    lua_pushvalue(L, -1);
+    chunk->function_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    wl_list_insert(&cache->lru, &chunk->link);
+    ++cache->len;
+
+    return 0;
+}
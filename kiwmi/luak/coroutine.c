@@ -0,0 +1,289 @@
+/* Copyright (c), Niclas Meyer <niclas@countingsort.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include "luak/coroutine.h"
+
+#include <stdlib.h>
+
+#include <lauxlib.h>
+#include <wayland-server.h>
+#include <wlr/util/log.h>
+
+#include "luak/kiwmi_lua_callback.h"
+
+static void
+coroutine_resume(
+    struct kiwmi_lua *lua,
+    lua_State *from,
+    lua_State *co,
+    int nargs)
+{
+    int nres;
+    int status = luaK_callback_resume(lua, from, co, nargs, &nres);
+
+    if (status == LUA_YIELD) {
+        lua_pop(co, nres);
+        return;
+    }
+
+    if (status != 0) {
+        wlr_log(WLR_ERROR, "Error in coroutine: %s", lua_tostring(co, -1));
+    }
+
+    lua_settop(co, 0);
+}
+
+void
+luaK_coroutine_start(lua_State *L, struct kiwmi_lua *lua, int nargs)
+{
+    lua_State *co = lua_newthread(L);
+
+    // Keep the thread on the stack, so it can't get collected while running.
+    lua_insert(L, -(nargs + 2));
+    lua_xmove(L, co, nargs + 1);
+
+    coroutine_resume(lua, L, co, nargs);
+
+    lua_pop(L, 1);
+}
+
+struct kiwmi_lua_waiter *
+luaK_waiter_new(lua_State *L, struct kiwmi_lua *lua)
+{
+    if (lua_pushthread(L)) {
+        lua_pop(L, 1);
+        luaL_error(L, "must be called from a coroutine (see kiwmi:async())");
+        return NULL;
+    }
+
+    struct kiwmi_lua_waiter *waiter = malloc(sizeof(*waiter));
+    if (!waiter) {
+        lua_pop(L, 1);
+        luaL_error(L, "failed to allocate kiwmi_lua_waiter");
+        return NULL;
+    }
+
+    waiter->lua          = lua;
+    waiter->co           = L;
+    waiter->thread_ref   = luaL_ref(L, LUA_REGISTRYINDEX);
+    waiter->nargs        = 0;
+    waiter->event_source = NULL;
+    waiter->lc           = NULL;
+    waiter->object_ref   = LUA_NOREF;
+    waiter->fired        = false;
+
+    wl_list_init(&waiter->destroy.link);
+    wl_list_init(&waiter->child_link);
+
+    wl_list_insert(&lua->waiters, &waiter->link);
+
+    return waiter;
+}
+
+static void
+waiter_destroy(struct kiwmi_lua_waiter *waiter)
+{
+    lua_State *L = waiter->lua->L;
+
+    if (waiter->event_source) {
+        wl_event_source_remove(waiter->event_source);
+    }
+
+    if (waiter->lc) {
+        luaK_callback_free(waiter->lua, waiter->lc);
+    }
+
+    luaL_unref(L, LUA_REGISTRYINDEX, waiter->object_ref);
+    luaL_unref(L, LUA_REGISTRYINDEX, waiter->thread_ref);
+
+    wl_list_remove(&waiter->destroy.link);
+    wl_list_remove(&waiter->child_link);
+    wl_list_remove(&waiter->link);
+
+    free(waiter);
+}
+
+void
+luaK_waiter_resume(struct kiwmi_lua_waiter *waiter)
+{
+    lua_State *L  = waiter->lua->L;
+    lua_State *co = waiter->co;
+    int nargs     = waiter->nargs;
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, waiter->thread_ref);
+    waiter_destroy(waiter);
+
+    coroutine_resume(waiter->lua, L, co, nargs);
+
+    lua_pop(L, 1);
+}
+
+static void
+waiter_idle_notify(void *data)
+{
+    struct kiwmi_lua_waiter *waiter = data;
+
+    // idle sources are removed after they fired
+    waiter->event_source = NULL;
+
+    luaK_waiter_resume(waiter);
+}
+
+static int
+waiter_timer_notify(void *data)
+{
+    luaK_waiter_resume(data);
+    return 0;
+}
+
+void
+luaK_waiter_resume_later(struct kiwmi_lua_waiter *waiter)
+{
+    if (waiter->event_source) {
+        return;
+    }
+
+    waiter->event_source = wl_event_loop_add_idle(
+        waiter->lua->server->wl_event_loop, waiter_idle_notify, waiter);
+    if (!waiter->event_source) {
+        wlr_log(WLR_ERROR, "Failed to defer coroutine, resuming right away");
+        luaK_waiter_resume(waiter);
+    }
+}
+
+void
+luaK_waiters_destroy(struct kiwmi_lua *lua)
+{
+    // Called before the state is closed, on shutdown and on every reload.
+    struct kiwmi_lua_waiter *waiter;
+    struct kiwmi_lua_waiter *tmp;
+    wl_list_for_each_safe (waiter, tmp, &lua->waiters, link) {
+        waiter_destroy(waiter);
+    }
+}
+
+int
+luaK_sleep(lua_State *L, struct kiwmi_lua *lua, int delay)
+{
+    struct kiwmi_lua_waiter *waiter = luaK_waiter_new(L, lua);
+    struct wl_event_loop *loop      = lua->server->wl_event_loop;
+
+    // A timer with a delay of 0 would be disarmed.
+    if (delay > 0) {
+        waiter->event_source =
+            wl_event_loop_add_timer(loop, waiter_timer_notify, waiter);
+        if (waiter->event_source
+            && wl_event_source_timer_update(waiter->event_source, delay) < 0) {
+            wl_event_source_remove(waiter->event_source);
+            waiter->event_source = NULL;
+        }
+    } else {
+        waiter->event_source =
+            wl_event_loop_add_idle(loop, waiter_idle_notify, waiter);
+    }
+
+    if (!waiter->event_source) {
+        waiter_destroy(waiter);
+        return luaL_error(L, "failed to arm timer");
+    }
+
+    return lua_yield(L, 0);
+}
+
+static int
+wait_notify(lua_State *L)
+{
+    struct kiwmi_lua_waiter *waiter = lua_touserdata(L, lua_upvalueindex(1));
+
+    // The callback is only removed on the next idle.
+    if (waiter->fired) {
+        return 0;
+    }
+
+    waiter->fired = true;
+
+    // Pass the event arguments on as the results of kiwmi:wait().
+    int nargs = lua_gettop(L);
+    if (lua_checkstack(waiter->co, nargs)) {
+        lua_xmove(L, waiter->co, nargs);
+        waiter->nargs = nargs;
+    }
+
+    // Resuming right away would run the coroutine while the signal is still
+    // being emitted.
+    luaK_waiter_resume_later(waiter);
+
+    return 0;
+}
+
+static void
+wait_destroy_notify(struct wl_listener *listener, void *UNUSED(data))
+{
+    struct kiwmi_lua_waiter *waiter =
+        wl_container_of(listener, waiter, destroy);
+
+    wl_list_remove(&waiter->destroy.link);
+    wl_list_init(&waiter->destroy.link);
+
+    // freed along with the object
+    waiter->lc = NULL;
+
+    if (!waiter->fired) {
+        waiter->fired = true;
+        luaK_waiter_resume_later(waiter);
+    }
+}
+
+int
+luaK_wait(lua_State *L, struct kiwmi_lua *lua, int object, int event)
+{
+    luaL_checktype(L, object, LUA_TUSERDATA);
+    luaL_checktype(L, event, LUA_TSTRING);
+
+    // Only kiwmi objects have events.
+    bool has_events = false;
+    if (lua_getmetatable(L, object)) {
+        lua_getfield(L, -1, "__events");
+        has_events = lua_istable(L, -1);
+        lua_pop(L, 2);
+    }
+    luaL_argcheck(L, has_events, object, "has no events");
+
+    struct kiwmi_object *obj =
+        *(struct kiwmi_object **)lua_touserdata(L, object);
+    if (!obj->valid) {
+        return luaL_argerror(L, object, "no longer valid");
+    }
+
+    struct kiwmi_lua_waiter *waiter = luaK_waiter_new(L, lua);
+    struct wl_list *first           = obj->callbacks.next;
+
+    lua_pushcfunction(L, luaK_callback_register_dispatch);
+    lua_pushvalue(L, object);
+    lua_pushvalue(L, event);
+    lua_pushlightuserdata(L, waiter);
+    lua_pushcclosure(L, wait_notify, 1);
+    if (lua_pcall(L, 3, 0, 0)) {
+        waiter_destroy(waiter);
+        return lua_error(L);
+    }
+
+    if (obj->callbacks.next == first) {
+        waiter_destroy(waiter);
+        return luaL_argerror(L, event, "can't be waited for");
+    }
+
+    waiter->lc = wl_container_of(obj->callbacks.next, waiter->lc, link);
+
+    lua_pushvalue(L, object);
+    waiter->object_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    waiter->destroy.notify = wait_destroy_notify;
+    wl_signal_add(&obj->events.destroy, &waiter->destroy);
+
+    return lua_yield(L, 0);
+}
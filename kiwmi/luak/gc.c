@@ -0,0 +1,129 @@
+/* Copyright (c), Niclas Meyer <niclas@countingsort.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include "luak/gc.h"
+
+#include <lua.h>
+#include <wayland-server.h>
+
+#include "clock.h"
+#include "luak/luak.h"
+
+static void
+gc_run(struct kiwmi_lua *lua)
+{
+    struct kiwmi_gc *gc = &lua->gc;
+    lua_State *L        = lua->L;
+
+    uint64_t start_nsec = clock_now_nsec();
+    uint64_t now_nsec   = start_nsec;
+
+    gc->in_cycle = true;
+    do {
+        ++gc->stats.steps;
+
+        if (lua_gc(L, LUA_GCSTEP, 0)) {
+            ++gc->stats.cycles;
+            gc->in_cycle = false;
+
+            // Like the automatic collector, wait for the heap to double.
+            gc->threshold_kb = lua_gc(L, LUA_GCCOUNT, 0) * 2;
+            if (gc->threshold_kb < KIWMI_GC_MIN_THRESHOLD_KB) {
+                gc->threshold_kb = KIWMI_GC_MIN_THRESHOLD_KB;
+            }
+        }
+
+        now_nsec = clock_now_nsec();
+    } while (gc->in_cycle && now_nsec - start_nsec < gc->budget_nsec);
+
+    // Stepping restarts the automatic collector on Lua 5.1.
+    lua_gc(L, LUA_GCSTOP, 0);
+
+    uint64_t elapsed_nsec = now_nsec - start_nsec;
+
+    ++gc->stats.runs;
+    gc->stats.total_nsec += elapsed_nsec;
+    gc->stats.last_nsec = elapsed_nsec;
+    if (elapsed_nsec > gc->stats.max_nsec) {
+        gc->stats.max_nsec = elapsed_nsec;
+    }
+}
+
+static void
+gc_idle_notify(void *data)
+{
+    struct kiwmi_lua *lua = data;
+
+    lua->gc.idle = NULL;
+
+    if (lua->gc.budget_nsec > 0) {
+        gc_run(lua);
+    }
+}
+
+void
+luaK_gc_init(struct kiwmi_lua *lua, struct wl_event_loop *event_loop)
+{
+    struct kiwmi_gc *gc = &lua->gc;
+
+    gc->event_loop   = event_loop;
+    gc->idle         = NULL;
+    gc->budget_nsec  = KIWMI_GC_BUDGET_DEFAULT_NSEC;
+    gc->in_cycle     = false;
+    gc->threshold_kb = KIWMI_GC_MIN_THRESHOLD_KB;
+    gc->stats        = (struct kiwmi_gc_stats){0};
+
+    lua_gc(lua->L, LUA_GCSTOP, 0);
+}
+
+void
+luaK_gc_fini(struct kiwmi_lua *lua)
+{
+    if (lua->gc.idle) {
+        wl_event_source_remove(lua->gc.idle);
+        lua->gc.idle = NULL;
+    }
+}
+
+void
+luaK_gc_schedule(struct kiwmi_lua *lua)
+{
+    struct kiwmi_gc *gc = &lua->gc;
+
+    if (gc->idle || gc->budget_nsec == 0) {
+        return;
+    }
+
+    if (!gc->in_cycle && lua_gc(lua->L, LUA_GCCOUNT, 0) < gc->threshold_kb) {
+        return;
+    }
+
+    gc->idle = wl_event_loop_add_idle(gc->event_loop, gc_idle_notify, lua);
+}
+
+void
+luaK_gc_schedule_if_grown(struct kiwmi_lua *lua)
+{
+    if (lua_gc(lua->L, LUA_GCCOUNT, 0) >= 2 * lua->gc.threshold_kb) {
+        luaK_gc_schedule(lua);
+    }
+}
+
+void
+luaK_gc_set_budget(struct kiwmi_lua *lua, uint64_t budget_nsec)
+{
+    struct kiwmi_gc *gc = &lua->gc;
+
+    gc->budget_nsec = budget_nsec;
+
+    if (budget_nsec == 0) {
+        luaK_gc_fini(lua);
+        lua_gc(lua->L, LUA_GCRESTART, 0);
+    } else {
+        lua_gc(lua->L, LUA_GCSTOP, 0);
+    }
+}
@@ -7,78 +7,483 @@
 
 #include "luak/ipc.h"
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include <lauxlib.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_output_layout.h>
+#include <wlr/util/box.h>
 #include <wlr/util/log.h>
 
-#include "kiwmi-ipc-protocol.h"
+#include "clock.h"
+#include "desktop/output.h"
+#include "desktop/view.h"
+#include "luak/gc.h"
+#include "luak/json.h"
 #include "luak/luak.h"
 
+// keeps every message well below the 4096 byte limit of libwayland
+#define KIWMI_IPC_CHUNK_SIZE 3072
+// All chunks of a result are queued at once, this keeps a single result
+// within the socket buffer. Clients pipelining commands have to bound the
+// replies in flight themselves, like kiwmic does.
+#define KIWMI_IPC_MAX_RESULT (128 * 1024)
+
+struct kiwmi_event_stream {
+    struct wl_list link; // struct kiwmi_server::event_streams
+    struct kiwmi_server *server;
+    struct wl_resource *resource;
+    uint32_t types;
+};
+
+static void
+event_stream_destroy(
+    struct wl_client *UNUSED(client),
+    struct wl_resource *resource)
+{
+    wl_resource_destroy(resource);
+}
+
+static const struct kiwmi_event_stream_interface stream_implementation = {
+    .destroy = event_stream_destroy,
+};
+
+static void
+event_stream_resource_destroy(struct wl_resource *resource)
+{
+    struct kiwmi_event_stream *stream = wl_resource_get_user_data(resource);
+
+    --stream->server->ipc_resources;
+
+    wl_list_remove(&stream->link);
+    free(stream);
+}
+
+static void
+command_resource_destroy(struct wl_resource *resource)
+{
+    struct kiwmi_server *server = wl_resource_get_user_data(resource);
+
+    --server->ipc_resources;
+}
+
+// Like wl_callback, the command is gone once it's done.
+static void
+ipc_command_done(
+    struct wl_resource *command_resource,
+    enum kiwmi_command_error error,
+    const char *message)
+{
+    kiwmi_command_send_done(command_resource, error, message);
+    wl_resource_destroy(command_resource);
+}
+
+static void
+ipc_command_fail(
+    struct kiwmi_lua *lua,
+    struct wl_resource *command_resource,
+    const char *error)
+{
+    ++lua->ipc_stats.failures;
+
+    wlr_log(WLR_ERROR, "Error running IPC command: %s", error);
+    ipc_command_done(command_resource, KIWMI_COMMAND_ERROR_FAILURE, error);
+}
+
+static void
+ipc_command_send_result(
+    struct kiwmi_lua *lua,
+    struct wl_resource *command_resource,
+    const char *result,
+    size_t len)
+{
+    if (len > KIWMI_IPC_MAX_RESULT) {
+        char error[64];
+        snprintf(
+            error,
+            sizeof(error),
+            "result too large (%zu bytes, at most %d)",
+            len,
+            KIWMI_IPC_MAX_RESULT);
+        ipc_command_fail(lua, command_resource, error);
+        return;
+    }
+
+    // Older clients can't put chunks back together.
+    if (wl_resource_get_version(command_resource)
+        >= KIWMI_COMMAND_CHUNK_SINCE_VERSION) {
+        char chunk[KIWMI_IPC_CHUNK_SIZE + 1];
+        while (len > KIWMI_IPC_CHUNK_SIZE) {
+            memcpy(chunk, result, KIWMI_IPC_CHUNK_SIZE);
+            chunk[KIWMI_IPC_CHUNK_SIZE] = '\0';
+            kiwmi_command_send_chunk(command_resource, chunk);
+
+            result += KIWMI_IPC_CHUNK_SIZE;
+            len -= KIWMI_IPC_CHUNK_SIZE;
+        }
+    }
+
+    ipc_command_done(command_resource, KIWMI_COMMAND_ERROR_SUCCESS, result);
+}
+
+static void
+ipc_command_send_json(
+    struct kiwmi_lua *lua,
+    struct wl_resource *command_resource,
+    int nresults)
+{
+    lua_State *L = lua->L;
+
+    if (nresults == 0) {
+        lua_pushnil(L);
+    } else if (nresults > 1) {
+        int first = lua_gettop(L) - nresults + 1;
+
+        lua_createtable(L, nresults, 0);
+        for (int i = 0; i < nresults; ++i) {
+            lua_pushvalue(L, first + i);
+            lua_rawseti(L, -2, i + 1);
+        }
+    }
+
+    uint64_t start_nsec = clock_now_nsec();
+
+    size_t len;
+    const char *error;
+    char *json = luaK_json_encode(L, -1, &len, &error);
+
+    lua->ipc_stats.format_nsec += clock_now_nsec() - start_nsec;
+
+    if (!json) {
+        ipc_command_fail(lua, command_resource, error);
+        return;
+    }
+
+    ipc_command_send_result(lua, command_resource, json, len);
+
+    free(json);
+}
+
+// Calls the function below the nargs arguments on top of the stack and sends
+// the result, either as JSON or passed through tostring().
+static void
+ipc_command_run(
+    struct kiwmi_lua *lua,
+    struct wl_resource *command_resource,
+    int nargs,
+    bool json)
+{
+    lua_State *L = lua->L;
+    int top      = lua_gettop(L) - nargs - 1;
+
+    lua_pushboolean(L, true);
+    lua_setglobal(L, "FROM_KIWMIC");
+
+    uint64_t start_nsec = clock_now_nsec();
+
+    int error = lua_pcall(L, nargs, LUA_MULTRET, 0);
+
+    lua->ipc_stats.run_nsec += clock_now_nsec() - start_nsec;
+
+    lua_pushboolean(L, false);
+    lua_setglobal(L, "FROM_KIWMIC");
+
+    if (error) {
+        ipc_command_fail(lua, command_resource, lua_tostring(L, -1));
+        lua_settop(L, top);
+        return;
+    }
+
+    if (json) {
+        ipc_command_send_json(lua, command_resource, lua_gettop(L) - top);
+        lua_settop(L, top);
+        return;
+    }
+
+    if (lua_gettop(L) == top) {
+        ipc_command_done(command_resource, KIWMI_COMMAND_ERROR_SUCCESS, "");
+        return;
+    }
+
+    start_nsec = clock_now_nsec();
+
+    lua_getglobal(L, "tostring");
+    lua_insert(L, -2);
+
+    error = lua_pcall(L, 1, 1, 0);
+
+    lua->ipc_stats.format_nsec += clock_now_nsec() - start_nsec;
+
+    if (error) {
+        ipc_command_fail(lua, command_resource, lua_tostring(L, -1));
+        lua_settop(L, top);
+        return;
+    }
+
+    size_t len;
+    const char *result = lua_tolstring(L, -1, &len);
+    ipc_command_send_result(lua, command_resource, result, len);
+
+    lua_settop(L, top);
+}
+
+// Called once every command is done, whether it failed or not.
+static void
+ipc_command_finish(struct kiwmi_lua *lua, uint64_t start_nsec)
+{
+    struct kiwmi_ipc_stats *stats = &lua->ipc_stats;
+    uint64_t elapsed_nsec         = clock_now_nsec() - start_nsec;
+
+    ++stats->commands;
+    stats->total_nsec += elapsed_nsec;
+    if (elapsed_nsec > stats->max_nsec) {
+        stats->max_nsec = elapsed_nsec;
+    }
+
+    // A status bar polling a static screen would otherwise grow the heap
+    // without bound.
+    luaK_gc_schedule_if_grown(lua);
+}
+
+// Named commands are compiled once on registration, so only anonymous ones go
+// through the chunk cache.
+static int
+ipc_command_load(struct kiwmi_lua *lua, const char *command, const char *name)
+{
+    uint64_t start_nsec = clock_now_nsec();
+
+    int error = name ? luaL_loadbuffer(lua->L, command, strlen(command), name)
+                     : luaK_chunk_cache_load(lua, command);
+
+    lua->ipc_stats.compile_nsec += clock_now_nsec() - start_nsec;
+
+    return error;
+}
+
+static struct wl_resource *
+ipc_command_create(
+    struct wl_client *client,
+    struct wl_resource *resource,
+    uint32_t id)
+{
+    struct kiwmi_server *server = wl_resource_get_user_data(resource);
+
+    struct wl_resource *command_resource = wl_resource_create(
+        client,
+        &kiwmi_command_interface,
+        wl_resource_get_version(resource),
+        id);
+    if (!command_resource) {
+        wl_client_post_no_memory(client);
+        return NULL;
+    }
+
+    wl_resource_set_implementation(
+        command_resource, NULL, server, command_resource_destroy);
+    ++server->ipc_resources;
+
+    return command_resource;
+}
+
+static void
+ipc_eval_common(
+    struct wl_client *client,
+    struct wl_resource *resource,
+    uint32_t id,
+    const char *message,
+    bool json)
+{
+    struct kiwmi_server *server = wl_resource_get_user_data(resource);
+    struct kiwmi_lua *lua       = server->lua;
+
+    struct wl_resource *command_resource =
+        ipc_command_create(client, resource, id);
+    if (!command_resource) {
+        return;
+    }
+
+    uint64_t start_nsec = clock_now_nsec();
+
+    if (ipc_command_load(lua, message, NULL)) {
+        ipc_command_fail(lua, command_resource, lua_tostring(lua->L, -1));
+        lua_pop(lua->L, 1);
+    } else {
+        ipc_command_run(lua, command_resource, 0, json);
+    }
+
+    ipc_command_finish(lua, start_nsec);
+}
+
 static void
 ipc_eval(
     struct wl_client *client,
     struct wl_resource *resource,
     uint32_t id,
     const char *message)
+{
+    ipc_eval_common(client, resource, id, message, false);
+}
+
+static void
+ipc_eval_json(
+    struct wl_client *client,
+    struct wl_resource *resource,
+    uint32_t id,
+    const char *message)
+{
+    ipc_eval_common(client, resource, id, message, true);
+}
+
+static void
+ipc_register_command(
+    struct wl_client *client,
+    struct wl_resource *resource,
+    uint32_t id,
+    const char *name,
+    const char *command)
 {
     struct kiwmi_server *server = wl_resource_get_user_data(resource);
-    struct wl_resource *command_resource =
-        wl_resource_create(client, &kiwmi_command_interface, 1, id);
-    lua_State *L = server->lua->L;
+    struct kiwmi_lua *lua       = server->lua;
+    lua_State *L                = lua->L;
 
-    int top = lua_gettop(L);
+    struct wl_resource *command_resource =
+        ipc_command_create(client, resource, id);
+    if (!command_resource) {
+        return;
+    }
 
-    lua_pushboolean(L, true);
-    lua_setglobal(L, "FROM_KIWMIC");
+    uint64_t start_nsec = clock_now_nsec();
 
-    if (luaL_dostring(L, message)) {
-        const char *error = lua_tostring(L, -1);
-        wlr_log(WLR_ERROR, "Error running IPC command: %s", error);
-        kiwmi_command_send_done(
-            command_resource, KIWMI_COMMAND_ERROR_FAILURE, error);
+    if (ipc_command_load(lua, command, name)) {
+        ipc_command_fail(lua, command_resource, lua_tostring(L, -1));
         lua_pop(L, 1);
+        ipc_command_finish(lua, start_nsec);
+        return;
+    }
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, lua->ipc_commands);
+    lua_pushstring(L, name);
+    lua_pushvalue(L, -3);
+    lua_rawset(L, -3);
+    lua_pop(L, 2);
+
+    ipc_command_done(command_resource, KIWMI_COMMAND_ERROR_SUCCESS, "");
 
-        lua_pushboolean(L, false);
-        lua_setglobal(L, "FROM_KIWMIC");
+    ipc_command_finish(lua, start_nsec);
+}
+
+static void
+ipc_call_command(
+    struct wl_client *client,
+    struct wl_resource *resource,
+    uint32_t id,
+    const char *name,
+    struct wl_array *args)
+{
+    struct kiwmi_server *server = wl_resource_get_user_data(resource);
+    struct kiwmi_lua *lua       = server->lua;
+    lua_State *L                = lua->L;
 
+    struct wl_resource *command_resource =
+        ipc_command_create(client, resource, id);
+    if (!command_resource) {
         return;
     }
 
-    lua_pushboolean(L, false);
-    lua_setglobal(L, "FROM_KIWMIC");
+    uint64_t start_nsec = clock_now_nsec();
 
-    int results = top - lua_gettop(L);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, lua->ipc_commands);
+    lua_getfield(L, -1, name);
+    lua_remove(L, -2);
 
-    if (results == 0) {
-        kiwmi_command_send_done(
-            command_resource, KIWMI_COMMAND_ERROR_SUCCESS, "");
-    } else {
-        lua_getglobal(L, "tostring");
-        lua_insert(L, -2);
-
-        if (lua_pcall(L, 1, 1, 0)) {
-            const char *error = lua_tostring(L, -1);
-            wlr_log(WLR_ERROR, "Error running IPC command: %s", error);
-            kiwmi_command_send_done(
-                command_resource, KIWMI_COMMAND_ERROR_FAILURE, error);
-            lua_pop(L, 1);
+    if (!lua_isfunction(L, -1)) {
+        lua_pop(L, 1);
+        ipc_command_fail(
+            lua, command_resource, lua_pushfstring(L, "no command '%s'", name));
+        lua_pop(L, 1);
+        ipc_command_finish(lua, start_nsec);
+        return;
+    }
+
+    // args are NUL terminated strings one after the other
+    int nargs       = 0;
+    const char *arg = args->data;
+    const char *end = arg + args->size;
+    while (arg < end) {
+        if (!lua_checkstack(L, 1)) {
+            lua_pop(L, nargs + 1);
+            ipc_command_fail(lua, command_resource, "too many arguments");
+            ipc_command_finish(lua, start_nsec);
             return;
         }
 
-        kiwmi_command_send_done(
-            command_resource, KIWMI_COMMAND_ERROR_SUCCESS, lua_tostring(L, -1));
+        size_t len = strnlen(arg, end - arg);
+        lua_pushlstring(L, arg, len);
+        ++nargs;
+
+        arg += len + 1;
     }
 
-    lua_pop(L, results);
+    ipc_command_run(lua, command_resource, nargs, false);
+
+    ipc_command_finish(lua, start_nsec);
+}
+
+static void
+ipc_subscribe(
+    struct wl_client *client,
+    struct wl_resource *resource,
+    uint32_t id,
+    uint32_t types)
+{
+    struct kiwmi_server *server = wl_resource_get_user_data(resource);
+
+    struct kiwmi_event_stream *stream = malloc(sizeof(*stream));
+    if (!stream) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    stream->resource = wl_resource_create(
+        client,
+        &kiwmi_event_stream_interface,
+        wl_resource_get_version(resource),
+        id);
+    if (!stream->resource) {
+        free(stream);
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    stream->server = server;
+    stream->types  = types;
+
+    wl_resource_set_implementation(
+        stream->resource,
+        &stream_implementation,
+        stream,
+        event_stream_resource_destroy);
+    ++server->ipc_resources;
+
+    wl_list_insert(&server->event_streams, &stream->link);
 }
 
 static const struct kiwmi_ipc_interface kiwmi_ipc_implementation = {
-    .eval = ipc_eval,
+    .eval             = ipc_eval,
+    .subscribe        = ipc_subscribe,
+    .register_command = ipc_register_command,
+    .call_command     = ipc_call_command,
+    .eval_json        = ipc_eval_json,
 };
 
 static void
-kiwmi_server_resource_destroy(struct wl_resource *UNUSED(resource))
+kiwmi_server_resource_destroy(struct wl_resource *resource)
 {
-    // EMPTY
+    struct kiwmi_server *server = wl_resource_get_user_data(resource);
+
+    --server->ipc_resources;
 }
 
 static void
@@ -101,13 +506,17 @@ ipc_server_bind(
         &kiwmi_ipc_implementation,
         server,
         kiwmi_server_resource_destroy);
+    ++server->ipc_resources;
 }
 
 bool
 luaK_ipc_init(struct kiwmi_server *server, struct kiwmi_lua *lua)
 {
+    lua_newtable(lua->L);
+    lua->ipc_commands = luaL_ref(lua->L, LUA_REGISTRYINDEX);
+
     lua->global = wl_global_create(
-        server->wl_display, &kiwmi_ipc_interface, 1, server, ipc_server_bind);
+        server->wl_display, &kiwmi_ipc_interface, 4, server, ipc_server_bind);
     if (!lua->global) {
         wlr_log(WLR_ERROR, "Failed to create IPC global");
         return false;
@@ -115,3 +524,74 @@ luaK_ipc_init(struct kiwmi_server *server, struct kiwmi_lua *lua)
 
     return true;
 }
+
+void
+luaK_ipc_view_event(
+    struct kiwmi_view *view,
+    enum kiwmi_event_stream_type type)
+{
+    struct kiwmi_server *server =
+        wl_container_of(view->desktop, server, desktop);
+
+    // Don't bother formatting anything without subscribers.
+    if (wl_list_empty(&server->event_streams)) {
+        return;
+    }
+
+    // formatted like view:id()
+    char id[32];
+    snprintf(id, sizeof(id), "%zu", (size_t)view);
+
+    const char *app_id = view_get_app_id(view);
+    const char *title  = view_get_title(view);
+
+    struct kiwmi_event_stream *stream;
+    wl_list_for_each (stream, &server->event_streams, link) {
+        if (stream->types & type) {
+            kiwmi_event_stream_send_view(
+                stream->resource,
+                type,
+                id,
+                app_id ? app_id : "",
+                title ? title : "");
+        }
+    }
+}
+
+void
+luaK_ipc_output_event(
+    struct kiwmi_output *output,
+    enum kiwmi_event_stream_type type)
+{
+    struct kiwmi_server *server =
+        wl_container_of(output->desktop, server, desktop);
+
+    if (wl_list_empty(&server->event_streams)) {
+        return;
+    }
+
+    struct wlr_box box = {0};
+    if (type == KIWMI_EVENT_STREAM_TYPE_OUTPUT_USABLE_AREA) {
+        box = output->usable_area;
+    } else if (type == KIWMI_EVENT_STREAM_TYPE_OUTPUT_NEW) {
+        struct wlr_box *layout_box = wlr_output_layout_get_box(
+            output->desktop->output_layout, output->wlr_output);
+        if (layout_box) {
+            box = *layout_box;
+        }
+    }
+
+    struct kiwmi_event_stream *stream;
+    wl_list_for_each (stream, &server->event_streams, link) {
+        if (stream->types & type) {
+            kiwmi_event_stream_send_output(
+                stream->resource,
+                type,
+                output->wlr_output->name,
+                box.x,
+                box.y,
+                box.width,
+                box.height);
+        }
+    }
+}
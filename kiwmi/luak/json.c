@@ -0,0 +1,272 @@
+/* Copyright (c), Niclas Meyer <niclas@countingsort.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include "luak/json.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <lauxlib.h>
+
+#include "luak/lua_compat.h"
+
+struct json_buffer {
+    char *data;
+    size_t len;
+    size_t capacity;
+    const char *error; // set on the first failure
+};
+
+static void
+json_append(struct json_buffer *buf, const char *data, size_t len)
+{
+    if (buf->error) {
+        return;
+    }
+
+    if (buf->len + len + 1 > buf->capacity) {
+        size_t capacity = buf->capacity ? buf->capacity : 256;
+        while (buf->len + len + 1 > capacity) {
+            capacity *= 2;
+        }
+
+        char *new_data = realloc(buf->data, capacity);
+        if (!new_data) {
+            buf->error = "out of memory";
+            return;
+        }
+
+        buf->data     = new_data;
+        buf->capacity = capacity;
+    }
+
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+    buf->data[buf->len] = '\0';
+}
+
+static void
+json_append_string(struct json_buffer *buf, const char *str, size_t len)
+{
+    json_append(buf, "\"", 1);
+
+    // Copy runs of characters that don't need escaping at once.
+    size_t run = 0;
+    for (size_t i = 0; i < len; ++i) {
+        unsigned char c = str[i];
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+
+        json_append(buf, str + run, i - run);
+        run = i + 1;
+
+        char escape[8];
+        switch (c) {
+        case '"':
+            json_append(buf, "\\\"", 2);
+            break;
+        case '\\':
+            json_append(buf, "\\\\", 2);
+            break;
+        case '\n':
+            json_append(buf, "\\n", 2);
+            break;
+        case '\r':
+            json_append(buf, "\\r", 2);
+            break;
+        case '\t':
+            json_append(buf, "\\t", 2);
+            break;
+        default:
+            snprintf(escape, sizeof(escape), "\\u%04x", c);
+            json_append(buf, escape, 6);
+            break;
+        }
+    }
+
+    json_append(buf, str + run, len - run);
+    json_append(buf, "\"", 1);
+}
+
+static void
+json_append_number(struct json_buffer *buf, lua_State *L, int idx)
+{
+    char number[32];
+
+#if LUA_VERSION_NUM >= 503
+    if (lua_isinteger(L, idx)) {
+        snprintf(
+            number, sizeof(number), "%lld", (long long)lua_tointeger(L, idx));
+        json_append(buf, number, strlen(number));
+        return;
+    }
+#endif
+
+    double value = lua_tonumber(L, idx);
+    if (!isfinite(value)) {
+        json_append(buf, "null", 4);
+        return;
+    }
+
+    // Lua 5.1 and 5.2 have no integers, don't print 3 as 3.0000000000000000.
+    if (value > -9007199254740992.0 && value < 9007199254740992.0
+        && value == (double)(long long)value) {
+        snprintf(number, sizeof(number), "%lld", (long long)value);
+    } else {
+        snprintf(number, sizeof(number), "%.17g", value);
+    }
+
+    json_append(buf, number, strlen(number));
+}
+
+static bool
+json_table_is_array(lua_State *L, int idx)
+{
+    size_t len   = luaC_rawlen(L, idx);
+    size_t count = 0;
+
+    lua_pushnil(L);
+    while (lua_next(L, idx)) {
+        lua_pop(L, 1);
+        ++count;
+    }
+
+    return count == len;
+}
+
+static void json_append_value(
+    struct json_buffer *buf,
+    lua_State *L,
+    int idx,
+    int depth);
+
+static void
+json_append_table(struct json_buffer *buf, lua_State *L, int idx, int depth)
+{
+    if (depth >= KIWMI_JSON_MAX_DEPTH) {
+        buf->error = "tables nested too deeply";
+        return;
+    }
+
+    if (!lua_checkstack(L, 4)) {
+        buf->error = "stack overflow";
+        return;
+    }
+
+    if (json_table_is_array(L, idx)) {
+        size_t len = luaC_rawlen(L, idx);
+
+        json_append(buf, "[", 1);
+        for (size_t i = 1; i <= len && !buf->error; ++i) {
+            if (i > 1) {
+                json_append(buf, ",", 1);
+            }
+
+            lua_rawgeti(L, idx, i);
+            json_append_value(buf, L, lua_gettop(L), depth + 1);
+            lua_pop(L, 1);
+        }
+        json_append(buf, "]", 1);
+
+        return;
+    }
+
+    json_append(buf, "{", 1);
+
+    bool first = true;
+    lua_pushnil(L);
+    while (lua_next(L, idx)) {
+        if (buf->error) {
+            lua_pop(L, 2);
+            return;
+        }
+
+        int key_type = lua_type(L, -2);
+        if (key_type != LUA_TSTRING && key_type != LUA_TNUMBER) {
+            buf->error = "table keys have to be strings or numbers";
+            lua_pop(L, 2);
+            return;
+        }
+
+        if (!first) {
+            json_append(buf, ",", 1);
+        }
+        first = false;
+
+        // lua_tolstring() on the key itself would confuse lua_next().
+        lua_pushvalue(L, -2);
+        size_t key_len;
+        const char *key = lua_tolstring(L, -1, &key_len);
+        json_append_string(buf, key, key_len);
+        lua_pop(L, 1);
+
+        json_append(buf, ":", 1);
+        json_append_value(buf, L, lua_gettop(L), depth + 1);
+
+        lua_pop(L, 1);
+    }
+
+    json_append(buf, "}", 1);
+}
+
+static void
+json_append_value(struct json_buffer *buf, lua_State *L, int idx, int depth)
+{
+    switch (lua_type(L, idx)) {
+    case LUA_TNIL:
+        json_append(buf, "null", 4);
+        break;
+    case LUA_TBOOLEAN:
+        if (lua_toboolean(L, idx)) {
+            json_append(buf, "true", 4);
+        } else {
+            json_append(buf, "false", 5);
+        }
+        break;
+    case LUA_TNUMBER:
+        json_append_number(buf, L, idx);
+        break;
+    case LUA_TSTRING: {
+        size_t len;
+        const char *str = lua_tolstring(L, idx, &len);
+        json_append_string(buf, str, len);
+        break;
+    }
+    case LUA_TTABLE:
+        json_append_table(buf, L, idx, depth);
+        break;
+    default:
+        if (!buf->error) {
+            buf->error = "value can't be encoded as JSON";
+        }
+        break;
+    }
+}
+
+char *
+luaK_json_encode(lua_State *L, int idx, size_t *len, const char **error)
+{
+    if (idx < 0) {
+        idx = lua_gettop(L) + idx + 1;
+    }
+
+    struct json_buffer buf = {0};
+    json_append_value(&buf, L, idx, 0);
+
+    if (buf.error) {
+        *error = buf.error;
+        free(buf.data);
+        return NULL;
+    }
+
+    *len = buf.len;
+    return buf.data;
+}
@@ -0,0 +1,178 @@
+/* Copyright (c), Niclas Meyer <niclas@countingsort.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include "luak/kiwmi_child.h"
+
+#include <signal.h>
+#include <sys/wait.h>
+
+#include <lauxlib.h>
+#include <wayland-server.h>
+
+#include "luak/coroutine.h"
+#include "luak/lua_compat.h"
+#include "luak/luak.h"
+#include "server.h"
+
+static int
+l_kiwmi_child_kill(lua_State *L)
+{
+    struct kiwmi_child *child = luaL_checkudata(L, 1, "kiwmi_child");
+
+    int signal_number = SIGTERM;
+    if (!lua_isnoneornil(L, 2)) {
+        luaL_checktype(L, 2, LUA_TNUMBER);
+        signal_number = lua_tonumber(L, 2);
+    }
+
+    if (child->exited) {
+        lua_pushboolean(L, false);
+        return 1;
+    }
+
+    lua_pushboolean(L, kill(child->pid, signal_number) == 0);
+    return 1;
+}
+
+static int
+l_kiwmi_child_pid(lua_State *L)
+{
+    struct kiwmi_child *child = luaL_checkudata(L, 1, "kiwmi_child");
+
+    lua_pushinteger(L, child->pid);
+
+    return 1;
+}
+
+static int
+l_kiwmi_child_running(lua_State *L)
+{
+    struct kiwmi_child *child = luaL_checkudata(L, 1, "kiwmi_child");
+
+    lua_pushboolean(L, !child->exited);
+
+    return 1;
+}
+
+static int
+l_kiwmi_child_status(lua_State *L)
+{
+    struct kiwmi_child *child = luaL_checkudata(L, 1, "kiwmi_child");
+
+    if (!child->exited) {
+        return 0;
+    }
+
+    lua_pushinteger(L, child->status);
+
+    return 1;
+}
+
+static int
+l_kiwmi_child_wait(lua_State *L)
+{
+    struct kiwmi_child *child = luaL_checkudata(L, 1, "kiwmi_child");
+
+    if (child->exited) {
+        lua_pushinteger(L, child->status);
+        return 1;
+    }
+
+    struct kiwmi_lua_waiter *waiter = luaK_waiter_new(L, child->lua);
+    wl_list_insert(&child->waiters, &waiter->child_link);
+
+    return lua_yield(L, 0);
+}
+
+static const luaL_Reg kiwmi_child_methods[] = {
+    {"kill", l_kiwmi_child_kill},
+    {"pid", l_kiwmi_child_pid},
+    {"running", l_kiwmi_child_running},
+    {"status", l_kiwmi_child_status},
+    {"wait", l_kiwmi_child_wait},
+    {NULL, NULL},
+};
+
+static int
+kiwmi_child_gc(lua_State *L)
+{
+    struct kiwmi_child *child = lua_touserdata(L, 1);
+
+    wl_list_remove(&child->link);
+
+    return 0;
+}
+
+int
+luaK_kiwmi_child_new(lua_State *L)
+{
+    luaL_checktype(L, 1, LUA_TLIGHTUSERDATA); // kiwmi_lua
+    luaL_checktype(L, 2, LUA_TNUMBER);        // pid
+
+    struct kiwmi_lua *lua = lua_touserdata(L, 1);
+
+    struct kiwmi_child *child = lua_newuserdata(L, sizeof(*child));
+
+    child->lua    = lua;
+    child->pid    = lua_tonumber(L, 2);
+    child->exited = false;
+    child->status = 0;
+
+    wl_list_init(&child->waiters);
+    wl_list_insert(&lua->children, &child->link);
+
+    luaL_getmetatable(L, "kiwmi_child");
+    lua_setmetatable(L, -2);
+
+    return 1;
+}
+
+int
+luaK_kiwmi_child_register(lua_State *L)
+{
+    luaL_newmetatable(L, "kiwmi_child");
+
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+    luaC_setfuncs(L, kiwmi_child_methods, 0);
+
+    lua_pushcfunction(L, kiwmi_child_gc);
+    lua_setfield(L, -2, "__gc");
+
+    return 0;
+}
+
+void
+luaK_kiwmi_child_exit_notify(struct wl_listener *listener, void *data)
+{
+    struct kiwmi_lua *lua = wl_container_of(listener, lua, child_exit);
+    struct kiwmi_child_exit_event *event = data;
+
+    struct kiwmi_child *child;
+    wl_list_for_each (child, &lua->children, link) {
+        if (child->pid != event->pid) {
+            continue;
+        }
+
+        int status    = event->status;
+        child->exited = true;
+        child->status = WIFEXITED(status) ? WEXITSTATUS(status)
+                                          : 128 + WTERMSIG(status);
+
+        struct kiwmi_lua_waiter *waiter;
+        struct kiwmi_lua_waiter *tmp;
+        wl_list_for_each_safe (waiter, tmp, &child->waiters, child_link) {
+            if (lua_checkstack(waiter->co, 1)) {
+                lua_pushinteger(waiter->co, child->status);
+                waiter->nargs = 1;
+            }
+            luaK_waiter_resume_later(waiter);
+        }
+
+        break;
+    }
+}
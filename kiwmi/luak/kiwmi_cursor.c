@@ -14,6 +14,7 @@
 #include <wlr/types/wlr_pointer.h>
 #include <wlr/util/log.h>
 
+#include "desktop/output.h"
 #include "desktop/view.h"
 #include "input/cursor.h"
 #include "luak/kiwmi_lua_callback.h"
@@ -22,6 +23,25 @@
 #include "luak/lua_compat.h"
 #include "luak/luak.h"
 
+static int
+l_kiwmi_cursor_focus_stats(lua_State *L)
+{
+    struct kiwmi_object *obj =
+        *(struct kiwmi_object **)luaL_checkudata(L, 1, "kiwmi_cursor");
+
+    struct kiwmi_cursor *cursor = obj->object;
+
+    lua_newtable(L);
+
+    lua_pushnumber(L, cursor->focus_stats.refreshes);
+    lua_setfield(L, -2, "refreshes");
+
+    lua_pushnumber(L, cursor->focus_stats.avoided);
+    lua_setfield(L, -2, "avoided");
+
+    return 1;
+}
+
 static int
 l_kiwmi_cursor_output_at_pos(lua_State *L)
 {
@@ -31,6 +51,8 @@ l_kiwmi_cursor_output_at_pos(lua_State *L)
     struct kiwmi_cursor *cursor = obj->object;
     struct kiwmi_server *server = cursor->server;
 
+    output_change_flush(&server->desktop);
+
     struct wlr_output *wlr_output = wlr_output_layout_output_at(
         server->desktop.output_layout, cursor->cursor->x, cursor->cursor->y);
 
@@ -92,7 +114,9 @@ l_kiwmi_cursor_view_at_pos(lua_State *L)
 }
 
 static const luaL_Reg kiwmi_cursor_methods[] = {
+    {"focus_stats", l_kiwmi_cursor_focus_stats},
     {"on", luaK_callback_register_dispatch},
+    {"once", luaK_callback_register_once},
     {"output_at_pos", l_kiwmi_cursor_output_at_pos},
     {"pos", l_kiwmi_cursor_pos},
     {"view_at_pos", l_kiwmi_cursor_view_at_pos},
@@ -109,11 +133,15 @@ kiwmi_cursor_on_button_down_or_up_notify(
     lua_State *L                  = server->lua->L;
     struct kiwmi_cursor_button_event *event = data;
 
+    if (lc->dead) {
+        return;
+    }
+
     lua_rawgeti(L, LUA_REGISTRYINDEX, lc->callback_ref);
 
     lua_pushinteger(L, event->wlr_event->button - BTN_LEFT + 1);
 
-    if (lua_pcall(L, 1, 1, 0)) {
+    if (luaK_callback_pcall(lc->server->lua, &lc->stats, 1, 1)) {
         wlr_log(WLR_ERROR, "%s", lua_tostring(L, -1));
         lua_pop(L, 1);
         return;
@@ -131,6 +159,10 @@ kiwmi_cursor_on_motion_notify(struct wl_listener *listener, void *data)
     lua_State *L                  = server->lua->L;
     struct kiwmi_cursor_motion_event *event = data;
 
+    if (lc->dead) {
+        return;
+    }
+
     lua_rawgeti(L, LUA_REGISTRYINDEX, lc->callback_ref);
 
     lua_newtable(L);
@@ -147,7 +179,34 @@ kiwmi_cursor_on_motion_notify(struct wl_listener *listener, void *data)
     lua_pushnumber(L, event->newy);
     lua_setfield(L, -2, "newy");
 
-    if (lua_pcall(L, 1, 0, 0)) {
+    if (luaK_callback_pcall(lc->server->lua, &lc->stats, 1, 0)) {
+        wlr_log(WLR_ERROR, "%s", lua_tostring(L, -1));
+        lua_pop(L, 1);
+    }
+}
+
+static void
+kiwmi_cursor_on_motion_coalesced_notify(
+    struct wl_listener *listener,
+    void *data)
+{
+    struct kiwmi_lua_callback *lc = wl_container_of(listener, lc, listener);
+    struct kiwmi_server *server   = lc->server;
+    lua_State *L                  = server->lua->L;
+    struct kiwmi_cursor_motion_event *event = data;
+
+    if (lc->dead) {
+        return;
+    }
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, lc->callback_ref);
+
+    lua_pushnumber(L, event->oldx);
+    lua_pushnumber(L, event->oldy);
+    lua_pushnumber(L, event->newx);
+    lua_pushnumber(L, event->newy);
+
+    if (luaK_callback_pcall(lc->server->lua, &lc->stats, 4, 0)) {
         wlr_log(WLR_ERROR, "%s", lua_tostring(L, -1));
         lua_pop(L, 1);
     }
@@ -161,6 +220,10 @@ kiwmi_cursor_on_scroll_notify(struct wl_listener *listener, void *data)
     lua_State *L                  = server->lua->L;
     struct kiwmi_cursor_scroll_event *event = data;
 
+    if (lc->dead) {
+        return;
+    }
+
     lua_rawgeti(L, LUA_REGISTRYINDEX, lc->callback_ref);
 
     lua_newtable(L);
@@ -174,7 +237,7 @@ kiwmi_cursor_on_scroll_notify(struct wl_listener *listener, void *data)
     lua_pushnumber(L, event->length);
     lua_setfield(L, -2, "length");
 
-    if (lua_pcall(L, 1, 1, 0)) {
+    if (luaK_callback_pcall(lc->server->lua, &lc->stats, 1, 1)) {
         wlr_log(WLR_ERROR, "%s", lua_tostring(L, -1));
         lua_pop(L, 1);
     }
@@ -258,6 +321,31 @@ l_kiwmi_cursor_on_motion(lua_State *L)
     return 0;
 }
 
+static int
+l_kiwmi_cursor_on_motion_coalesced(lua_State *L)
+{
+    struct kiwmi_object *obj =
+        *(struct kiwmi_object **)luaL_checkudata(L, 1, "kiwmi_cursor");
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+
+    struct kiwmi_cursor *cursor = obj->object;
+    struct kiwmi_server *server = cursor->server;
+
+    lua_pushcfunction(L, luaK_kiwmi_lua_callback_new);
+    lua_pushlightuserdata(L, server);
+    lua_pushvalue(L, 2);
+    lua_pushlightuserdata(L, kiwmi_cursor_on_motion_coalesced_notify);
+    lua_pushlightuserdata(L, &cursor->events.motion_coalesced);
+    lua_pushlightuserdata(L, obj);
+
+    if (lua_pcall(L, 5, 0, 0)) {
+        wlr_log(WLR_ERROR, "%s", lua_tostring(L, -1));
+        return 0;
+    }
+
+    return 0;
+}
+
 static int
 l_kiwmi_cursor_on_scroll(lua_State *L)
 {
@@ -287,6 +375,7 @@ static const luaL_Reg kiwmi_cursor_events[] = {
     {"button_down", l_kiwmi_cursor_on_button_down},
     {"button_up", l_kiwmi_cursor_on_button_up},
     {"motion", l_kiwmi_cursor_on_motion},
+    {"motion_coalesced", l_kiwmi_cursor_on_motion_coalesced},
     {"scroll", l_kiwmi_cursor_on_scroll},
     {NULL, NULL},
 };
@@ -300,14 +389,8 @@ luaK_kiwmi_cursor_new(lua_State *L)
     struct kiwmi_lua *lua       = lua_touserdata(L, 1);
     struct kiwmi_cursor *cursor = lua_touserdata(L, 2);
 
-    struct kiwmi_object *obj =
-        luaK_get_kiwmi_object(lua, cursor, &cursor->events.destroy);
-
-    struct kiwmi_object **cursor_ud = lua_newuserdata(L, sizeof(*cursor_ud));
-    luaL_getmetatable(L, "kiwmi_cursor");
-    lua_setmetatable(L, -2);
-
-    *cursor_ud = obj;
+    luaK_push_kiwmi_object(
+        L, lua, cursor, &cursor->events.destroy, "kiwmi_cursor");
 
     return 1;
 }
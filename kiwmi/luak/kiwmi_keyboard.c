@@ -8,6 +8,7 @@
 #include "luak/kiwmi_keyboard.h"
 
 #include <stdint.h>
+#include <stdlib.h>
 
 #include <lauxlib.h>
 #include <wayland-server.h>
@@ -20,6 +21,133 @@
 #include "luak/kiwmi_lua_callback.h"
 #include "luak/lua_compat.h"
 
+struct kiwmi_lua_keybind {
+    struct kiwmi_keybind keybind;
+    struct kiwmi_lua *lua;
+    int callback_ref;
+    struct kiwmi_lua_callback_stats stats;
+};
+
+static void
+kiwmi_lua_keybind_handler(
+    struct kiwmi_keybind *keybind,
+    struct kiwmi_keyboard *keyboard)
+{
+    struct kiwmi_lua_keybind *lk = wl_container_of(keybind, lk, keybind);
+    struct kiwmi_lua *lua        = lk->lua;
+    lua_State *L                 = lua->L;
+
+    // The callback may unbind itself, don't touch lk after calling it.
+    lua_rawgeti(L, LUA_REGISTRYINDEX, lk->callback_ref);
+
+    lua_pushcfunction(L, luaK_kiwmi_keyboard_new);
+    lua_pushlightuserdata(L, lua);
+    lua_pushlightuserdata(L, keyboard);
+    if (lua_pcall(L, 2, 1, 0)) {
+        wlr_log(WLR_ERROR, "%s", lua_tostring(L, -1));
+        lua_pop(L, 2);
+        return;
+    }
+
+    if (luaK_callback_pcall(lua, &lk->stats, 1, 0)) {
+        wlr_log(WLR_ERROR, "%s", lua_tostring(L, -1));
+        lua_pop(L, 1);
+    }
+}
+
+static void
+kiwmi_lua_keybind_destroy(struct kiwmi_keybind *keybind)
+{
+    struct kiwmi_lua_keybind *lk = wl_container_of(keybind, lk, keybind);
+
+    luaK_callback_stats_forget(lk->lua, &lk->stats);
+
+    luaL_unref(lk->lua->L, LUA_REGISTRYINDEX, lk->callback_ref);
+
+    free(lk);
+}
+
+int
+luaK_kiwmi_keybind_bind(
+    lua_State *L,
+    struct kiwmi_lua *lua,
+    struct kiwmi_hashmap *keybinds)
+{
+    const char *binding = luaL_checkstring(L, 2);
+    luaL_checktype(L, 3, LUA_TFUNCTION);
+
+    uint32_t modifiers;
+    xkb_keysym_t sym;
+    if (!keybind_parse(binding, &modifiers, &sym)) {
+        return luaL_argerror(L, 2, "invalid keybind");
+    }
+
+    struct kiwmi_lua_keybind *lk = malloc(sizeof(*lk));
+    if (!lk) {
+        return luaL_error(L, "failed to allocate keybind");
+    }
+
+    lk->keybind.modifiers = modifiers;
+    lk->keybind.sym       = sym;
+    lk->keybind.handler   = kiwmi_lua_keybind_handler;
+    lk->keybind.destroy   = kiwmi_lua_keybind_destroy;
+    lk->lua               = lua;
+    luaK_callback_stats_init(&lk->stats, binding);
+
+    lua_pushvalue(L, 3);
+    lk->callback_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    if (!keybinds_add(keybinds, &lk->keybind)) {
+        kiwmi_lua_keybind_destroy(&lk->keybind);
+        return luaL_error(L, "failed to add keybind");
+    }
+
+    return 0;
+}
+
+struct kiwmi_lua_callback_stats *
+luaK_kiwmi_keybind_stats(struct kiwmi_keybind *keybind)
+{
+    if (keybind->destroy != kiwmi_lua_keybind_destroy) {
+        return NULL;
+    }
+
+    struct kiwmi_lua_keybind *lk = wl_container_of(keybind, lk, keybind);
+
+    return &lk->stats;
+}
+
+int
+luaK_kiwmi_keybind_unbind(lua_State *L, struct kiwmi_hashmap *keybinds)
+{
+    const char *binding = luaL_checkstring(L, 2);
+
+    uint32_t modifiers;
+    xkb_keysym_t sym;
+    if (!keybind_parse(binding, &modifiers, &sym)) {
+        return luaL_argerror(L, 2, "invalid keybind");
+    }
+
+    lua_pushboolean(L, keybinds_remove(keybinds, modifiers, sym));
+
+    return 1;
+}
+
+static int
+l_kiwmi_keyboard_bind(lua_State *L)
+{
+    struct kiwmi_object *obj =
+        *(struct kiwmi_object **)luaL_checkudata(L, 1, "kiwmi_keyboard");
+
+    if (!obj->valid) {
+        return luaL_error(L, "kiwmi_keyboard no longer valid");
+    }
+
+    struct kiwmi_keyboard *keyboard = obj->object;
+
+    return luaK_kiwmi_keybind_bind(L, obj->lua, &keyboard->keybinds);
+}
+
 static int
 l_kiwmi_keyboard_keymap(lua_State *L)
 {
@@ -114,10 +242,28 @@ l_kiwmi_keyboard_modifiers(lua_State *L)
     return 1;
 }
 
+static int
+l_kiwmi_keyboard_unbind(lua_State *L)
+{
+    struct kiwmi_object *obj =
+        *(struct kiwmi_object **)luaL_checkudata(L, 1, "kiwmi_keyboard");
+
+    if (!obj->valid) {
+        return luaL_error(L, "kiwmi_keyboard no longer valid");
+    }
+
+    struct kiwmi_keyboard *keyboard = obj->object;
+
+    return luaK_kiwmi_keybind_unbind(L, &keyboard->keybinds);
+}
+
 static const luaL_Reg kiwmi_keyboard_methods[] = {
+    {"bind", l_kiwmi_keyboard_bind},
     {"keymap", l_kiwmi_keyboard_keymap},
     {"modifiers", l_kiwmi_keyboard_modifiers},
     {"on", luaK_callback_register_dispatch},
+    {"once", luaK_callback_register_once},
+    {"unbind", l_kiwmi_keyboard_unbind},
     {NULL, NULL},
 };
 
@@ -129,6 +275,10 @@ kiwmi_keyboard_on_destroy_notify(struct wl_listener *listener, void *data)
     lua_State *L                    = server->lua->L;
     struct kiwmi_keyboard *keyboard = data;
 
+    if (lc->dead) {
+        return;
+    }
+
     lua_rawgeti(L, LUA_REGISTRYINDEX, lc->callback_ref);
 
     lua_pushcfunction(L, luaK_kiwmi_keyboard_new);
@@ -140,7 +290,7 @@ kiwmi_keyboard_on_destroy_notify(struct wl_listener *listener, void *data)
         return;
     }
 
-    if (lua_pcall(L, 1, 1, 0)) {
+    if (luaK_callback_pcall(lc->server->lua, &lc->stats, 1, 1)) {
         wlr_log(WLR_ERROR, "%s", lua_tostring(L, -1));
         lua_pop(L, 1);
         return;
@@ -186,7 +336,7 @@ send_key_event(
     }
     lua_setfield(L, -2, "keyboard");
 
-    if (lua_pcall(L, 1, 1, 0)) {
+    if (luaK_callback_pcall(lc->server->lua, &lc->stats, 1, 1)) {
         wlr_log(WLR_ERROR, "%s", lua_tostring(L, -1));
         lua_pop(L, 1);
         return false;
@@ -206,6 +356,10 @@ kiwmi_keyboard_on_key_down_or_up_notify(
     struct kiwmi_keyboard_key_event *event = data;
     struct kiwmi_keyboard *keyboard        = event->keyboard;
 
+    if (lc->dead) {
+        return;
+    }
+
     const xkb_keysym_t *raw_syms = event->raw_syms;
     int raw_syms_len             = event->raw_syms_len;
 
@@ -334,15 +488,8 @@ luaK_kiwmi_keyboard_new(lua_State *L)
     struct kiwmi_lua *lua           = lua_touserdata(L, 1);
     struct kiwmi_keyboard *keyboard = lua_touserdata(L, 2);
 
-    struct kiwmi_object *obj =
-        luaK_get_kiwmi_object(lua, keyboard, &keyboard->events.destroy);
-
-    struct kiwmi_object **keyboard_ud =
-        lua_newuserdata(L, sizeof(*keyboard_ud));
-    luaL_getmetatable(L, "kiwmi_keyboard");
-    lua_setmetatable(L, -2);
-
-    *keyboard_ud = obj;
+    luaK_push_kiwmi_object(
+        L, lua, keyboard, &keyboard->events.destroy, "kiwmi_keyboard");
 
     return 1;
 }
@@ -7,10 +7,23 @@
 
 #include "luak/kiwmi_lua_callback.h"
 
+#include <stdio.h>
 #include <stdlib.h>
 
 #include <lauxlib.h>
 #include <wayland-server.h>
+#include <wlr/util/log.h>
+
+#include "clock.h"
+#include "luak/gc.h"
+#include "luak/lua_compat.h"
+
+// instructions between two watchdog checks
+#define WATCHDOG_COUNT 1000
+
+// Hooks only get the lua_State (possibly a coroutine), so the kiwmi_lua is
+// kept in the registry under the address of this.
+static const char watchdog_key = 'w';
 
 int
 luaK_kiwmi_lua_callback_new(lua_State *L)
@@ -29,6 +42,10 @@ luaK_kiwmi_lua_callback_new(lua_State *L)
     struct kiwmi_server *server = lua_touserdata(L, 1);
 
     lc->server = server;
+    lc->handle = NULL;
+    lc->dead   = false;
+    luaK_callback_stats_init(&lc->stats, "");
+    wl_list_init(&lc->dead_link);
 
     lua_pushvalue(L, 2);
     lc->callback_ref = luaL_ref(L, LUA_REGISTRYINDEX);
@@ -38,7 +55,322 @@ luaK_kiwmi_lua_callback_new(lua_State *L)
 
     struct kiwmi_object *object = lua_touserdata(L, 5);
 
+    lc->object = object;
     wl_list_insert(&object->callbacks, &lc->link);
 
     return 0;
 }
+
+// Drops everything lc holds in the Lua state, so nothing calls it anymore.
+static void
+callback_kill(struct kiwmi_lua *lua, struct kiwmi_lua_callback *lc)
+{
+    if (lc->dead) {
+        return;
+    }
+
+    lc->dead = true;
+
+    if (lc->handle) {
+        *lc->handle = NULL;
+        lc->handle  = NULL;
+    }
+
+    luaK_callback_stats_forget(lua, &lc->stats);
+
+    luaL_unref(lua->L, LUA_REGISTRYINDEX, lc->callback_ref);
+}
+
+static void
+dead_callbacks_idle_notify(void *data)
+{
+    struct kiwmi_lua *lua = data;
+
+    // idle sources are removed after they fired
+    lua->dead_callbacks_idle = NULL;
+
+    struct kiwmi_lua_callback *lc;
+    struct kiwmi_lua_callback *tmp;
+    wl_list_for_each_safe (lc, tmp, &lua->dead_callbacks, dead_link) {
+        struct kiwmi_object *obj = lc->object;
+        luaK_callback_destroy(lua, lc);
+        luaK_kiwmi_object_release(obj);
+    }
+}
+
+void
+luaK_callback_free(struct kiwmi_lua *lua, struct kiwmi_lua_callback *lc)
+{
+    if (lc->dead) {
+        return;
+    }
+
+    callback_kill(lua, lc);
+
+    // wl_signal_emit() might already hold on to lc as the next listener, so
+    // it stays on the signal until then.
+    wl_list_insert(&lua->dead_callbacks, &lc->dead_link);
+
+    if (!lua->dead_callbacks_idle) {
+        lua->dead_callbacks_idle = wl_event_loop_add_idle(
+            lua->server->wl_event_loop, dead_callbacks_idle_notify, lua);
+        if (!lua->dead_callbacks_idle) {
+            // still freed along with its object
+            wlr_log(WLR_ERROR, "Failed to defer freeing a callback");
+        }
+    }
+}
+
+void
+luaK_callback_destroy(struct kiwmi_lua *lua, struct kiwmi_lua_callback *lc)
+{
+    callback_kill(lua, lc);
+
+    wl_list_remove(&lc->dead_link);
+    wl_list_remove(&lc->listener.link);
+    wl_list_remove(&lc->link);
+
+    free(lc);
+}
+
+static int
+l_kiwmi_lua_callback_active(lua_State *L)
+{
+    struct kiwmi_lua_callback **handle =
+        luaL_checkudata(L, 1, "kiwmi_lua_callback");
+
+    lua_pushboolean(L, *handle != NULL);
+    return 1;
+}
+
+static int
+l_kiwmi_lua_callback_off(lua_State *L)
+{
+    struct kiwmi_lua_callback **handle =
+        luaL_checkudata(L, 1, "kiwmi_lua_callback");
+
+    struct kiwmi_lua_callback *lc = *handle;
+    if (!lc) {
+        lua_pushboolean(L, false);
+        return 1;
+    }
+
+    luaK_callback_free(lc->server->lua, lc);
+
+    lua_pushboolean(L, true);
+    return 1;
+}
+
+static const luaL_Reg kiwmi_lua_callback_methods[] = {
+    {"active", l_kiwmi_lua_callback_active},
+    {"off", l_kiwmi_lua_callback_off},
+    {NULL, NULL},
+};
+
+static int
+kiwmi_lua_callback_gc(lua_State *L)
+{
+    struct kiwmi_lua_callback **handle = lua_touserdata(L, 1);
+
+    // Dropping the handle keeps the callback registered.
+    if (*handle) {
+        (*handle)->handle = NULL;
+    }
+
+    return 0;
+}
+
+void
+luaK_callback_push_handle(lua_State *L, struct kiwmi_lua_callback *lc)
+{
+    struct kiwmi_lua_callback **handle = lua_newuserdata(L, sizeof(*handle));
+    luaL_getmetatable(L, "kiwmi_lua_callback");
+    lua_setmetatable(L, -2);
+
+    *handle    = lc;
+    lc->handle = handle;
+}
+
+int
+luaK_kiwmi_lua_callback_register(lua_State *L)
+{
+    luaL_newmetatable(L, "kiwmi_lua_callback");
+
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+    luaC_setfuncs(L, kiwmi_lua_callback_methods, 0);
+
+    lua_pushcfunction(L, kiwmi_lua_callback_gc);
+    lua_setfield(L, -2, "__gc");
+
+    return 0;
+}
+
+void
+luaK_callback_stats_init(
+    struct kiwmi_lua_callback_stats *stats,
+    const char *event)
+{
+    snprintf(stats->event, sizeof(stats->event), "%s", event);
+    stats->calls      = 0;
+    stats->total_nsec = 0;
+    stats->max_nsec   = 0;
+}
+
+void
+luaK_callback_stats_forget(
+    struct kiwmi_lua *lua,
+    struct kiwmi_lua_callback_stats *stats)
+{
+    for (struct kiwmi_lua_call *call = lua->calls; call; call = call->prev) {
+        if (call->stats == stats) {
+            call->stats = NULL;
+        }
+    }
+}
+
+void
+luaK_watchdog_init(struct kiwmi_lua *lua)
+{
+    lua_pushlightuserdata(lua->L, (void *)&watchdog_key);
+    lua_pushlightuserdata(lua->L, lua);
+    lua_rawset(lua->L, LUA_REGISTRYINDEX);
+}
+
+static void
+watchdog_hook(lua_State *L, lua_Debug *UNUSED(ar))
+{
+    lua_pushlightuserdata(L, (void *)&watchdog_key);
+    lua_rawget(L, LUA_REGISTRYINDEX);
+    struct kiwmi_lua *lua = lua_touserdata(L, -1);
+    lua_pop(L, 1);
+
+    uint64_t elapsed_nsec = clock_now_nsec() - lua->callback_start_nsec;
+    if (elapsed_nsec < (uint64_t)lua->watchdog_ms * 1000000) {
+        return;
+    }
+
+    const char *event = "";
+    for (struct kiwmi_lua_call *call = lua->calls; call; call = call->prev) {
+        if (!call->prev && call->stats) {
+            event = call->stats->event;
+        }
+    }
+
+    if (lua->watchdog_abort) {
+        luaL_error(
+            L,
+            "%s callback aborted after running for %d ms",
+            event,
+            lua->watchdog_ms);
+        return;
+    }
+
+    if (!lua->watchdog_fired) {
+        lua->watchdog_fired = true;
+        wlr_log(
+            WLR_ERROR,
+            "%s callback running for more than %d ms",
+            event,
+            lua->watchdog_ms);
+    }
+}
+
+// Starts a call into L, nested calls count towards the outermost one.
+static bool
+watchdog_enter(
+    struct kiwmi_lua *lua,
+    lua_State *L,
+    struct kiwmi_lua_call *call,
+    uint64_t start_nsec)
+{
+    bool outermost = !lua->calls;
+    if (outermost) {
+        lua->callback_start_nsec = start_nsec;
+        lua->watchdog_fired      = false;
+    }
+
+    // Every thread has its own hook, a callback nested in a coroutine still
+    // runs on the main thread.
+    if (lua->watchdog_ms > 0) {
+        lua_sethook(L, watchdog_hook, LUA_MASKCOUNT, WATCHDOG_COUNT);
+    }
+
+    lua->calls = call;
+
+    return outermost;
+}
+
+static void
+watchdog_leave(
+    struct kiwmi_lua *lua,
+    lua_State *L,
+    struct kiwmi_lua_call *call,
+    bool outermost)
+{
+    lua->calls = call->prev;
+
+    if (L != lua->L) {
+        lua_sethook(L, NULL, 0, 0);
+    }
+
+    if (outermost) {
+        lua_sethook(lua->L, NULL, 0, 0);
+        luaK_gc_schedule_if_grown(lua);
+    }
+}
+
+int
+luaK_callback_pcall(
+    struct kiwmi_lua *lua,
+    struct kiwmi_lua_callback_stats *stats,
+    int nargs,
+    int nresults)
+{
+    lua_State *L = lua->L;
+
+    struct kiwmi_lua_call call = {
+        .stats = stats,
+        .prev  = lua->calls,
+    };
+
+    uint64_t start_nsec = clock_now_nsec();
+
+    bool outermost = watchdog_enter(lua, L, &call, start_nsec);
+    int ret        = lua_pcall(L, nargs, nresults, 0);
+    watchdog_leave(lua, L, &call, outermost);
+
+    uint64_t elapsed_nsec = clock_now_nsec() - start_nsec;
+
+    // The callback might have been removed in the meantime.
+    if (call.stats) {
+        ++call.stats->calls;
+        call.stats->total_nsec += elapsed_nsec;
+        if (elapsed_nsec > call.stats->max_nsec) {
+            call.stats->max_nsec = elapsed_nsec;
+        }
+    }
+
+    return ret;
+}
+
+int
+luaK_callback_resume(
+    struct kiwmi_lua *lua,
+    lua_State *from,
+    lua_State *co,
+    int nargs,
+    int *nres)
+{
+    // not a callback, so there is nothing to account the time to
+    struct kiwmi_lua_call call = {
+        .stats = NULL,
+        .prev  = lua->calls,
+    };
+
+    bool outermost = watchdog_enter(lua, co, &call, clock_now_nsec());
+    int status     = luaC_resume(co, from, nargs, nres);
+    watchdog_leave(lua, co, &call, outermost);
+
+    return status;
+}
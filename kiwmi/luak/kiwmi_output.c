@@ -7,7 +7,12 @@
 
 #include "luak/kiwmi_output.h"
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
 #include <lauxlib.h>
+#include <wlr/backend/headless.h>
 #include <wlr/types/wlr_output.h>
 #include <wlr/types/wlr_output_layout.h>
 #include <wlr/util/box.h>
@@ -18,6 +23,35 @@
 #include "luak/lua_compat.h"
 #include "server.h"
 
+static int
+l_kiwmi_output_adaptive_sync(lua_State *L)
+{
+    struct kiwmi_object *obj =
+        *(struct kiwmi_object **)luaL_checkudata(L, 1, "kiwmi_output");
+
+    if (!obj->valid) {
+        return luaL_error(L, "kiwmi_output no longer valid");
+    }
+
+    struct kiwmi_output *output = obj->object;
+
+    enum kiwmi_adaptive_sync adaptive_sync;
+    if (lua_isboolean(L, 2)) {
+        adaptive_sync = lua_toboolean(L, 2) ? KIWMI_ADAPTIVE_SYNC_ON
+                                            : KIWMI_ADAPTIVE_SYNC_OFF;
+    } else if (
+        lua_type(L, 2) == LUA_TSTRING
+        && strcmp(lua_tostring(L, 2), "auto") == 0) {
+        adaptive_sync = KIWMI_ADAPTIVE_SYNC_AUTO;
+    } else {
+        return luaL_argerror(L, 2, "expected bool or \"auto\"");
+    }
+
+    lua_pushboolean(L, output_set_adaptive_sync(output, adaptive_sync));
+
+    return 1;
+}
+
 static int
 l_kiwmi_output_auto(lua_State *L)
 {
@@ -36,6 +70,194 @@ l_kiwmi_output_auto(lua_State *L)
     return 0;
 }
 
+static void
+push_frame_stats_summary(
+    lua_State *L,
+    struct kiwmi_frame_stats *stats,
+    size_t offset,
+    bool skip_zero)
+{
+    uint64_t total = 0;
+    uint64_t max   = 0;
+    size_t count   = 0;
+
+    for (size_t i = 0; i < stats->count; ++i) {
+        char *sample   = (char *)&stats->samples[i];
+        uint64_t value = *(uint64_t *)(sample + offset);
+
+        if (skip_zero && value == 0) {
+            continue;
+        }
+
+        total += value;
+        if (value > max) {
+            max = value;
+        }
+        ++count;
+    }
+
+    lua_newtable(L);
+
+    lua_pushnumber(L, count ? total / 1e6 / count : 0);
+    lua_setfield(L, -2, "avg");
+
+    lua_pushnumber(L, max / 1e6);
+    lua_setfield(L, -2, "max");
+}
+
+static int
+l_kiwmi_output_destroy(lua_State *L)
+{
+    struct kiwmi_object *obj =
+        *(struct kiwmi_object **)luaL_checkudata(L, 1, "kiwmi_output");
+
+    if (!obj->valid) {
+        return luaL_error(L, "kiwmi_output no longer valid");
+    }
+
+    struct kiwmi_output *output = obj->object;
+
+    if (!wlr_output_is_headless(output->wlr_output)) {
+        return luaL_error(L, "only headless outputs can be destroyed");
+    }
+
+    wlr_output_destroy(output->wlr_output);
+
+    return 0;
+}
+
+static int
+l_kiwmi_output_frame_stats(lua_State *L)
+{
+    struct kiwmi_object *obj =
+        *(struct kiwmi_object **)luaL_checkudata(L, 1, "kiwmi_output");
+
+    if (!obj->valid) {
+        return luaL_error(L, "kiwmi_output no longer valid");
+    }
+
+    struct kiwmi_output *output     = obj->object;
+    struct kiwmi_frame_stats *stats = &output->frame_stats;
+
+    lua_newtable(L);
+
+    lua_pushnumber(L, stats->frames);
+    lua_setfield(L, -2, "frames");
+
+    lua_pushnumber(L, stats->skipped);
+    lua_setfield(L, -2, "skipped");
+
+    lua_pushnumber(L, stats->missed_vblanks);
+    lua_setfield(L, -2, "missed_vblanks");
+
+    lua_pushnumber(L, stats->vsync_frames);
+    lua_setfield(L, -2, "vsync_frames");
+
+    lua_pushnumber(L, stats->vrr_frames);
+    lua_setfield(L, -2, "vrr_frames");
+
+    lua_pushnumber(L, stats->deadline_frames);
+    lua_setfield(L, -2, "deadline_frames");
+
+    lua_pushnumber(L, stats->immediate_frames);
+    lua_setfield(L, -2, "immediate_frames");
+
+    lua_pushnumber(L, stats->occluded_callbacks);
+    lua_setfield(L, -2, "occluded_callbacks");
+
+    lua_pushinteger(L, output_max_render_time(output));
+    lua_setfield(L, -2, "max_render_time");
+
+    push_frame_stats_summary(
+        L,
+        stats,
+        offsetof(struct kiwmi_frame_sample, frame_to_commit_nsec),
+        false);
+    lua_setfield(L, -2, "frame_to_commit");
+
+    push_frame_stats_summary(
+        L, stats, offsetof(struct kiwmi_frame_sample, commit_nsec), false);
+    lua_setfield(L, -2, "commit");
+
+    // frames without presentation feedback have no latency to report
+    push_frame_stats_summary(
+        L, stats, offsetof(struct kiwmi_frame_sample, present_nsec), true);
+    lua_setfield(L, -2, "present");
+
+    lua_createtable(L, stats->count, 0);
+    size_t first = (stats->head + KIWMI_FRAME_STATS_SAMPLES - stats->count)
+        % KIWMI_FRAME_STATS_SAMPLES;
+    for (size_t i = 0; i < stats->count; ++i) {
+        struct kiwmi_frame_sample *sample =
+            &stats->samples[(first + i) % KIWMI_FRAME_STATS_SAMPLES];
+
+        lua_createtable(L, 0, 3);
+
+        lua_pushnumber(L, sample->frame_to_commit_nsec / 1e6);
+        lua_setfield(L, -2, "frame_to_commit");
+
+        lua_pushnumber(L, sample->commit_nsec / 1e6);
+        lua_setfield(L, -2, "commit");
+
+        lua_pushnumber(L, sample->present_nsec / 1e6);
+        lua_setfield(L, -2, "present");
+
+        lua_rawseti(L, -2, i + 1);
+    }
+    lua_setfield(L, -2, "samples");
+
+    lua_createtable(L, KIWMI_FRAME_STATS_BUCKETS, 0);
+    for (size_t i = 0; i < KIWMI_FRAME_STATS_BUCKETS; ++i) {
+        lua_createtable(L, 0, 2);
+
+        if (i < KIWMI_FRAME_STATS_BUCKETS - 1) {
+            lua_pushnumber(L, output_frame_stats_bucket_limit(i) / 1e6);
+            lua_setfield(L, -2, "limit");
+        }
+
+        lua_pushnumber(L, stats->histogram[i]);
+        lua_setfield(L, -2, "count");
+
+        lua_rawseti(L, -2, i + 1);
+    }
+    lua_setfield(L, -2, "histogram");
+
+    return 1;
+}
+
+static int
+l_kiwmi_output_max_render_time(lua_State *L)
+{
+    struct kiwmi_object *obj =
+        *(struct kiwmi_object **)luaL_checkudata(L, 1, "kiwmi_output");
+
+    if (!obj->valid) {
+        return luaL_error(L, "kiwmi_output no longer valid");
+    }
+
+    struct kiwmi_output *output = obj->object;
+
+    if (lua_type(L, 2) == LUA_TSTRING) {
+        if (strcmp(lua_tostring(L, 2), "auto") != 0) {
+            return luaL_argerror(L, 2, "expected number or \"auto\"");
+        }
+
+        output->max_render_time = KIWMI_MAX_RENDER_TIME_AUTO;
+        return 0;
+    }
+
+    luaL_checktype(L, 2, LUA_TNUMBER);
+
+    int max_render_time = lua_tonumber(L, 2);
+    if (max_render_time < 0) {
+        return luaL_argerror(L, 2, "must not be negative");
+    }
+
+    output->max_render_time = max_render_time;
+
+    return 0;
+}
+
 static int
 l_kiwmi_output_move(lua_State *L)
 {
@@ -89,6 +311,8 @@ l_kiwmi_output_pos(lua_State *L)
     struct kiwmi_output *output             = obj->object;
     struct wlr_output_layout *output_layout = output->desktop->output_layout;
 
+    output_change_flush(output->desktop);
+
     struct wlr_box *box =
         wlr_output_layout_get_box(output_layout, output->wlr_output);
 
@@ -128,6 +352,8 @@ l_kiwmi_output_usable_area(lua_State *L)
 
     struct kiwmi_output *output = obj->object;
 
+    output_change_flush(output->desktop);
+
     lua_newtable(L);
 
     lua_pushinteger(L, output->usable_area.x);
@@ -146,10 +372,15 @@ l_kiwmi_output_usable_area(lua_State *L)
 }
 
 static const luaL_Reg kiwmi_output_methods[] = {
+    {"adaptive_sync", l_kiwmi_output_adaptive_sync},
     {"auto", l_kiwmi_output_auto},
+    {"destroy", l_kiwmi_output_destroy},
+    {"frame_stats", l_kiwmi_output_frame_stats},
+    {"max_render_time", l_kiwmi_output_max_render_time},
     {"move", l_kiwmi_output_move},
     {"name", l_kiwmi_output_name},
     {"on", luaK_callback_register_dispatch},
+    {"once", luaK_callback_register_once},
     {"pos", l_kiwmi_output_pos},
     {"size", l_kiwmi_output_size},
     {"usable_area", l_kiwmi_output_usable_area},
@@ -164,6 +395,10 @@ kiwmi_output_on_destroy_notify(struct wl_listener *listener, void *data)
     lua_State *L                  = server->lua->L;
     struct kiwmi_output *output   = data;
 
+    if (lc->dead) {
+        return;
+    }
+
     lua_rawgeti(L, LUA_REGISTRYINDEX, lc->callback_ref);
 
     lua_pushcfunction(L, luaK_kiwmi_output_new);
@@ -176,7 +411,7 @@ kiwmi_output_on_destroy_notify(struct wl_listener *listener, void *data)
         return;
     }
 
-    if (lua_pcall(L, 1, 0, 0)) {
+    if (luaK_callback_pcall(lc->server->lua, &lc->stats, 1, 0)) {
         wlr_log(WLR_ERROR, "%s", lua_tostring(L, -1));
         lua_pop(L, 1);
     }
@@ -190,6 +425,10 @@ kiwmi_output_on_resize_notify(struct wl_listener *listener, void *data)
     lua_State *L                  = server->lua->L;
     struct kiwmi_output *output   = data;
 
+    if (lc->dead) {
+        return;
+    }
+
     int width;
     int height;
     wlr_output_transformed_resolution(output->wlr_output, &width, &height);
@@ -216,7 +455,7 @@ kiwmi_output_on_resize_notify(struct wl_listener *listener, void *data)
     lua_pushinteger(L, height);
     lua_setfield(L, -2, "height");
 
-    if (lua_pcall(L, 1, 0, 0)) {
+    if (luaK_callback_pcall(lc->server->lua, &lc->stats, 1, 0)) {
         wlr_log(WLR_ERROR, "%s", lua_tostring(L, -1));
         lua_pop(L, 1);
     }
@@ -232,6 +471,10 @@ kiwmi_output_on_usable_area_change_notify(
     lua_State *L                  = server->lua->L;
     struct kiwmi_output *output   = data;
 
+    if (lc->dead) {
+        return;
+    }
+
     lua_rawgeti(L, LUA_REGISTRYINDEX, lc->callback_ref);
 
     lua_newtable(L);
@@ -260,7 +503,7 @@ kiwmi_output_on_usable_area_change_notify(
     lua_pushinteger(L, output->usable_area.height);
     lua_setfield(L, -2, "height");
 
-    if (lua_pcall(L, 1, 0, 0)) {
+    if (luaK_callback_pcall(lc->server->lua, &lc->stats, 1, 0)) {
         wlr_log(WLR_ERROR, "%s", lua_tostring(L, -1));
         lua_pop(L, 1);
     }
@@ -372,14 +615,8 @@ luaK_kiwmi_output_new(lua_State *L)
     struct kiwmi_lua *lua       = lua_touserdata(L, 1);
     struct kiwmi_output *output = lua_touserdata(L, 2);
 
-    struct kiwmi_object *obj =
-        luaK_get_kiwmi_object(lua, output, &output->events.destroy);
-
-    struct kiwmi_object **output_ud = lua_newuserdata(L, sizeof(*output_ud));
-    luaL_getmetatable(L, "kiwmi_output");
-    lua_setmetatable(L, -2);
-
-    *output_ud = obj;
+    luaK_push_kiwmi_object(
+        L, lua, output, &output->events.destroy, "kiwmi_output");
 
     return 1;
 }
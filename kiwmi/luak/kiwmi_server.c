@@ -7,21 +7,31 @@
 
 #include "luak/kiwmi_server.h"
 
+#include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <unistd.h>
 
 #include <lauxlib.h>
 #include <wayland-server.h>
+#include <wlr/backend/headless.h>
 #include <wlr/types/wlr_cursor.h>
+#include <wlr/types/wlr_output.h>
 #include <wlr/types/wlr_output_layout.h>
 #include <wlr/util/log.h>
 
 #include "color.h"
+#include "desktop/output.h"
+#include "desktop/output_management.h"
+#include "desktop/transaction.h"
 #include "desktop/view.h"
 #include "input/cursor.h"
 #include "input/input.h"
 #include "input/seat.h"
+#include "luak/coroutine.h"
+#include "luak/gc.h"
+#include "luak/kiwmi_child.h"
 #include "luak/kiwmi_cursor.h"
 #include "luak/kiwmi_keyboard.h"
 #include "luak/kiwmi_lua_callback.h"
@@ -51,6 +61,29 @@ l_kiwmi_server_active_output(lua_State *L)
     return 1;
 }
 
+static int
+l_kiwmi_server_bind(lua_State *L)
+{
+    struct kiwmi_object *obj =
+        *(struct kiwmi_object **)luaL_checkudata(L, 1, "kiwmi_server");
+
+    struct kiwmi_server *server = obj->object;
+
+    return luaK_kiwmi_keybind_bind(L, obj->lua, &server->input.keybinds);
+}
+
+static int
+l_kiwmi_server_async(lua_State *L)
+{
+    struct kiwmi_object *obj =
+        *(struct kiwmi_object **)luaL_checkudata(L, 1, "kiwmi_server");
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+
+    luaK_coroutine_start(L, obj->lua, lua_gettop(L) - 2);
+
+    return 0;
+}
+
 static int
 l_kiwmi_server_bg_color(lua_State *L)
 {
@@ -75,6 +108,240 @@ l_kiwmi_server_bg_color(lua_State *L)
     return 0;
 }
 
+static const char *const output_transforms[] = {
+    [WL_OUTPUT_TRANSFORM_NORMAL]      = "normal",
+    [WL_OUTPUT_TRANSFORM_90]          = "90",
+    [WL_OUTPUT_TRANSFORM_180]         = "180",
+    [WL_OUTPUT_TRANSFORM_270]         = "270",
+    [WL_OUTPUT_TRANSFORM_FLIPPED]     = "flipped",
+    [WL_OUTPUT_TRANSFORM_FLIPPED_90]  = "flipped-90",
+    [WL_OUTPUT_TRANSFORM_FLIPPED_180] = "flipped-180",
+    [WL_OUTPUT_TRANSFORM_FLIPPED_270] = "flipped-270",
+};
+
+static struct kiwmi_output *
+output_config_get_output(lua_State *L, struct kiwmi_server *server)
+{
+    if (lua_type(L, -1) == LUA_TSTRING) {
+        const char *name = lua_tostring(L, -1);
+
+        struct kiwmi_output *output;
+        wl_list_for_each (output, &server->desktop.outputs, link) {
+            if (strcmp(output->wlr_output->name, name) == 0) {
+                return output;
+            }
+        }
+
+        return NULL;
+    }
+
+    struct kiwmi_object **objp = luaK_toudata(L, -1, "kiwmi_output");
+    if (!objp || !(*objp)->valid) {
+        return NULL;
+    }
+
+    return (*objp)->object;
+}
+
+static int
+l_kiwmi_server_configure_outputs(lua_State *L)
+{
+    struct kiwmi_object *obj =
+        *(struct kiwmi_object **)luaL_checkudata(L, 1, "kiwmi_server");
+    luaL_checktype(L, 2, LUA_TTABLE);
+
+    struct kiwmi_server *server = obj->object;
+    bool test_only              = lua_toboolean(L, 3);
+
+    size_t count = 0;
+    for (;;) {
+        lua_rawgeti(L, 2, count + 1);
+        bool end = lua_isnil(L, -1);
+        lua_pop(L, 1);
+
+        if (end) {
+            break;
+        }
+
+        ++count;
+    }
+
+    // Owned by Lua, so it doesn't leak when a config entry is invalid.
+    struct kiwmi_output_config *configs =
+        lua_newuserdata(L, count * sizeof(*configs) + 1);
+
+    for (size_t i = 0; i < count; ++i) {
+        struct kiwmi_output_config *config = &configs[i];
+        int n                              = i + 1;
+
+        lua_rawgeti(L, 2, n);
+        if (!lua_istable(L, -1)) {
+            return luaL_error(L, "output config %d: table expected", n);
+        }
+
+        *config = (struct kiwmi_output_config){
+            .enabled = true,
+        };
+
+        lua_getfield(L, -1, "output");
+        config->output = output_config_get_output(L, server);
+        if (!config->output) {
+            return luaL_error(L, "output config %d: no such output", n);
+        }
+        lua_pop(L, 1);
+
+        for (size_t j = 0; j < i; ++j) {
+            if (configs[j].output == config->output) {
+                return luaL_error(
+                    L, "output config %d: output configured twice", n);
+            }
+        }
+
+        lua_getfield(L, -1, "enabled");
+        if (!lua_isnil(L, -1)) {
+            config->enabled = lua_toboolean(L, -1);
+        }
+        lua_pop(L, 1);
+
+        lua_getfield(L, -1, "width");
+        lua_getfield(L, -2, "height");
+        if (lua_isnumber(L, -2) && lua_isnumber(L, -1)) {
+            config->width  = lua_tonumber(L, -2);
+            config->height = lua_tonumber(L, -1);
+        } else if (!lua_isnil(L, -2) || !lua_isnil(L, -1)) {
+            return luaL_error(
+                L, "output config %d: width and height expected", n);
+        }
+        lua_pop(L, 2);
+
+        lua_getfield(L, -1, "refresh");
+        if (lua_isnumber(L, -1)) {
+            // Hz to mHz
+            config->refresh = lua_tonumber(L, -1) * 1000 + 0.5;
+        }
+        lua_pop(L, 1);
+
+        lua_getfield(L, -1, "x");
+        lua_getfield(L, -2, "y");
+        if (lua_isnumber(L, -2) && lua_isnumber(L, -1)) {
+            config->has_position = true;
+            config->x            = lua_tonumber(L, -2);
+            config->y            = lua_tonumber(L, -1);
+        }
+        lua_pop(L, 2);
+
+        lua_getfield(L, -1, "scale");
+        if (lua_isnumber(L, -1)) {
+            config->scale = lua_tonumber(L, -1);
+        }
+        lua_pop(L, 1);
+
+        lua_getfield(L, -1, "transform");
+        if (!lua_isnil(L, -1)) {
+            const char *transform = lua_tostring(L, -1);
+
+            size_t len_transforms =
+                sizeof(output_transforms) / sizeof(output_transforms[0]);
+            for (size_t j = 0; transform && j < len_transforms; ++j) {
+                if (strcmp(output_transforms[j], transform) == 0) {
+                    config->has_transform = true;
+                    config->transform     = j;
+                    break;
+                }
+            }
+
+            if (!config->has_transform) {
+                return luaL_error(L, "output config %d: invalid transform", n);
+            }
+        }
+        lua_pop(L, 1);
+
+        lua_pop(L, 1);
+    }
+
+    bool ok = output_config_apply(&server->desktop, configs, count, test_only);
+
+    lua_pushboolean(L, ok);
+
+    return 1;
+}
+
+static int
+l_kiwmi_server_create_output(lua_State *L)
+{
+    struct kiwmi_object *obj =
+        *(struct kiwmi_object **)luaL_checkudata(L, 1, "kiwmi_server");
+
+    struct kiwmi_server *server = obj->object;
+
+    lua_Number width   = 1920;
+    lua_Number height  = 1080;
+    lua_Number refresh = 0;
+
+    if (!lua_isnoneornil(L, 2)) {
+        luaL_checktype(L, 2, LUA_TTABLE);
+
+        lua_getfield(L, 2, "width");
+        if (!lua_isnil(L, -1)) {
+            width = luaL_checknumber(L, -1);
+        }
+        lua_getfield(L, 2, "height");
+        if (!lua_isnil(L, -1)) {
+            height = luaL_checknumber(L, -1);
+        }
+        lua_getfield(L, 2, "refresh");
+        if (!lua_isnil(L, -1)) {
+            refresh = luaL_checknumber(L, -1);
+        }
+        lua_pop(L, 3);
+    }
+
+    if (width < 1 || height < 1) {
+        return luaL_argerror(L, 2, "size must be positive");
+    }
+
+    if (refresh < 0) {
+        return luaL_argerror(L, 2, "refresh must not be negative");
+    }
+
+    struct wlr_output *wlr_output =
+        wlr_headless_add_output(server->headless_backend, width, height);
+    if (!wlr_output) {
+        return luaL_error(L, "failed to create headless output");
+    }
+
+    bool announced = wlr_output->data != NULL;
+
+    if (refresh > 0) {
+        // Hz to mHz; without a buffer attached only the mode is committed.
+        wlr_output_set_custom_mode(
+            wlr_output, width, height, refresh * 1000 + 0.5);
+        if (announced && !wlr_output_commit(wlr_output)) {
+            wlr_log(
+                WLR_ERROR,
+                "Failed to set refresh rate of %s",
+                wlr_output->name);
+        }
+    }
+
+    // Before the backend starts (e.g. while the config is loaded) the output
+    // only gets announced later, through the output event.
+    if (!announced) {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    lua_pushcfunction(L, luaK_kiwmi_output_new);
+    lua_pushlightuserdata(L, server->lua);
+    lua_pushlightuserdata(L, wlr_output->data);
+    if (lua_pcall(L, 2, 1, 0)) {
+        wlr_log(WLR_ERROR, "%s", lua_tostring(L, -1));
+        return 0;
+    }
+
+    return 1;
+}
+
 static int
 l_kiwmi_server_cursor(lua_State *L)
 {
@@ -117,6 +384,142 @@ l_kiwmi_server_focused_view(lua_State *L)
     return 1;
 }
 
+static int
+l_kiwmi_server_gc_budget(lua_State *L)
+{
+    struct kiwmi_object *obj =
+        *(struct kiwmi_object **)luaL_checkudata(L, 1, "kiwmi_server");
+    luaL_checktype(L, 2, LUA_TNUMBER);
+
+    struct kiwmi_server *server = obj->object;
+
+    double budget = lua_tonumber(L, 2);
+    if (budget < 0) {
+        return luaL_argerror(L, 2, "must not be negative");
+    }
+
+    luaK_gc_set_budget(server->lua, budget * 1e6);
+
+    return 0;
+}
+
+static int
+l_kiwmi_server_gc_stats(lua_State *L)
+{
+    struct kiwmi_object *obj =
+        *(struct kiwmi_object **)luaL_checkudata(L, 1, "kiwmi_server");
+
+    struct kiwmi_server *server  = obj->object;
+    struct kiwmi_gc_stats *stats = &server->lua->gc.stats;
+
+    lua_newtable(L);
+
+    lua_pushnumber(L, stats->runs);
+    lua_setfield(L, -2, "runs");
+
+    lua_pushnumber(L, stats->steps);
+    lua_setfield(L, -2, "steps");
+
+    lua_pushnumber(L, stats->cycles);
+    lua_setfield(L, -2, "cycles");
+
+    lua_pushnumber(L, stats->total_nsec / 1e6);
+    lua_setfield(L, -2, "total");
+
+    double avg = stats->runs ? stats->total_nsec / 1e6 / stats->runs : 0;
+    lua_pushnumber(L, avg);
+    lua_setfield(L, -2, "avg");
+
+    lua_pushnumber(L, stats->max_nsec / 1e6);
+    lua_setfield(L, -2, "max");
+
+    lua_pushnumber(L, stats->last_nsec / 1e6);
+    lua_setfield(L, -2, "last");
+
+    lua_pushnumber(L, lua_gc(L, LUA_GCCOUNT, 0));
+    lua_setfield(L, -2, "memory");
+
+    return 1;
+}
+
+static int
+l_kiwmi_server_ipc_stats(lua_State *L)
+{
+    struct kiwmi_object *obj =
+        *(struct kiwmi_object **)luaL_checkudata(L, 1, "kiwmi_server");
+
+    struct kiwmi_server *server           = obj->object;
+    struct kiwmi_lua *lua                 = server->lua;
+    struct kiwmi_ipc_stats *ipc           = &lua->ipc_stats;
+    struct kiwmi_chunk_cache_stats *cache = &lua->chunk_cache.stats;
+    bool reset                            = lua_toboolean(L, 2);
+
+    lua_newtable(L);
+
+    lua_pushnumber(L, ipc->commands);
+    lua_setfield(L, -2, "commands");
+
+    lua_pushnumber(L, ipc->failures);
+    lua_setfield(L, -2, "failures");
+
+    lua_pushnumber(L, ipc->total_nsec / 1e6);
+    lua_setfield(L, -2, "total");
+
+    double avg = ipc->commands ? ipc->total_nsec / 1e6 / ipc->commands : 0;
+    lua_pushnumber(L, avg);
+    lua_setfield(L, -2, "avg");
+
+    lua_pushnumber(L, ipc->max_nsec / 1e6);
+    lua_setfield(L, -2, "max");
+
+    lua_pushnumber(L, ipc->compile_nsec / 1e6);
+    lua_setfield(L, -2, "compile");
+
+    lua_pushnumber(L, ipc->run_nsec / 1e6);
+    lua_setfield(L, -2, "run");
+
+    lua_pushnumber(L, ipc->format_nsec / 1e6);
+    lua_setfield(L, -2, "format");
+
+    lua_pushnumber(L, cache->hits);
+    lua_setfield(L, -2, "cache_hits");
+
+    lua_pushnumber(L, cache->misses);
+    lua_setfield(L, -2, "cache_misses");
+
+    lua_pushnumber(L, cache->evictions);
+    lua_setfield(L, -2, "cache_evictions");
+
+    lua_pushnumber(L, server->ipc_resources);
+    lua_setfield(L, -2, "resources");
+
+    if (reset) {
+        *ipc   = (struct kiwmi_ipc_stats){0};
+        *cache = (struct kiwmi_chunk_cache_stats){0};
+    }
+
+    return 1;
+}
+
+static int
+l_kiwmi_server_occluded_frame_interval(lua_State *L)
+{
+    struct kiwmi_object *obj =
+        *(struct kiwmi_object **)luaL_checkudata(L, 1, "kiwmi_server");
+    luaL_checktype(L, 2, LUA_TNUMBER);
+
+    struct kiwmi_server *server = obj->object;
+
+    int interval = lua_tonumber(L, 2);
+    if (interval < 0) {
+        return luaL_argerror(L, 2, "must not be negative");
+    }
+
+    server->desktop.occluded_frame_interval = interval;
+
+    return 0;
+}
+
 static int
 l_kiwmi_server_output_at(lua_State *L)
 {
@@ -130,6 +533,8 @@ l_kiwmi_server_output_at(lua_State *L)
     double lx = lua_tonumber(L, 2);
     double ly = lua_tonumber(L, 3);
 
+    output_change_flush(&server->desktop);
+
     struct wlr_output *wlr_output =
         wlr_output_layout_output_at(server->desktop.output_layout, lx, ly);
 
@@ -148,6 +553,130 @@ l_kiwmi_server_output_at(lua_State *L)
     return 1;
 }
 
+static int
+l_kiwmi_server_output_debounce(lua_State *L)
+{
+    struct kiwmi_object *obj =
+        *(struct kiwmi_object **)luaL_checkudata(L, 1, "kiwmi_server");
+    luaL_checktype(L, 2, LUA_TNUMBER);
+
+    struct kiwmi_server *server = obj->object;
+
+    int debounce = lua_tonumber(L, 2);
+    if (debounce < 0) {
+        return luaL_argerror(L, 2, "must not be negative");
+    }
+
+    server->desktop.output_debounce = debounce;
+
+    return 0;
+}
+
+static void
+profile_push(
+    lua_State *L,
+    struct kiwmi_lua_callback_stats *stats,
+    int callbacks,
+    int *n,
+    bool reset)
+{
+    lua_newtable(L);
+
+    lua_pushstring(L, stats->event);
+    lua_setfield(L, -2, "event");
+
+    lua_pushnumber(L, stats->calls);
+    lua_setfield(L, -2, "calls");
+
+    lua_pushnumber(L, stats->total_nsec / 1e6);
+    lua_setfield(L, -2, "total");
+
+    double avg = stats->calls ? stats->total_nsec / 1e6 / stats->calls : 0;
+    lua_pushnumber(L, avg);
+    lua_setfield(L, -2, "avg");
+
+    lua_pushnumber(L, stats->max_nsec / 1e6);
+    lua_setfield(L, -2, "max");
+
+    // callbacks on the same object, to spot handlers piling up
+    if (callbacks > 0) {
+        lua_pushinteger(L, callbacks);
+        lua_setfield(L, -2, "callbacks");
+    }
+
+    lua_rawseti(L, -2, ++*n);
+
+    if (reset) {
+        stats->calls      = 0;
+        stats->total_nsec = 0;
+        stats->max_nsec   = 0;
+    }
+}
+
+static void
+profile_push_keybinds(
+    lua_State *L,
+    struct kiwmi_hashmap *keybinds,
+    int *n,
+    bool reset)
+{
+    for (size_t i = 0; i < keybinds->capacity; ++i) {
+        struct kiwmi_keybind *keybind = keybinds->entries[i].value;
+        if (!keybind) {
+            continue;
+        }
+
+        struct kiwmi_lua_callback_stats *stats =
+            luaK_kiwmi_keybind_stats(keybind);
+        if (stats) {
+            profile_push(L, stats, 0, n, reset);
+        }
+    }
+}
+
+static int
+l_kiwmi_server_profile(lua_State *L)
+{
+    struct kiwmi_object *obj =
+        *(struct kiwmi_object **)luaL_checkudata(L, 1, "kiwmi_server");
+
+    struct kiwmi_server *server = obj->object;
+    struct kiwmi_lua *lua       = server->lua;
+    bool reset                  = lua_toboolean(L, 2);
+
+    lua_newtable(L);
+    int n = 0;
+
+    // every callback registered with :on() belongs to an object
+    for (size_t i = 0; i < lua->objects.capacity; ++i) {
+        struct kiwmi_object *object = lua->objects.entries[i].value;
+        if (!object) {
+            continue;
+        }
+
+        int callbacks = wl_list_length(&object->callbacks);
+
+        struct kiwmi_lua_callback *lc;
+        wl_list_for_each (lc, &object->callbacks, link) {
+            profile_push(L, &lc->stats, callbacks, &n, reset);
+        }
+    }
+
+    struct kiwmi_lua_callback *lc;
+    wl_list_for_each (lc, &lua->scheduled_callbacks, link) {
+        profile_push(L, &lc->stats, 0, &n, reset);
+    }
+
+    profile_push_keybinds(L, &server->input.keybinds, &n, reset);
+
+    struct kiwmi_keyboard *keyboard;
+    wl_list_for_each (keyboard, &server->input.keyboards, link) {
+        profile_push_keybinds(L, &keyboard->keybinds, &n, reset);
+    }
+
+    return 1;
+}
+
 static int
 l_kiwmi_server_quit(lua_State *L)
 {
@@ -161,6 +690,37 @@ l_kiwmi_server_quit(lua_State *L)
     return 0;
 }
 
+static void
+kiwmi_server_reload_handler(void *data)
+{
+    struct kiwmi_server *server = data;
+
+    server->lua->reload_idle = NULL;
+
+    luaK_reload(server);
+}
+
+static int
+l_kiwmi_server_reload(lua_State *L)
+{
+    struct kiwmi_object *obj =
+        *(struct kiwmi_object **)luaL_checkudata(L, 1, "kiwmi_server");
+
+    struct kiwmi_server *server = obj->object;
+    struct kiwmi_lua *lua       = server->lua;
+
+    // The state can't be closed from within itself, so wait for the loop.
+    if (!lua->reload_idle) {
+        lua->reload_idle = wl_event_loop_add_idle(
+            server->wl_event_loop, kiwmi_server_reload_handler, server);
+        if (!lua->reload_idle) {
+            return luaL_error(L, "Failed to schedule reload");
+        }
+    }
+
+    return 0;
+}
+
 static int
 kiwmi_server_schedule_handler(void *data)
 {
@@ -169,7 +729,7 @@ kiwmi_server_schedule_handler(void *data)
 
     lua_rawgeti(L, LUA_REGISTRYINDEX, lc->callback_ref);
     lua_pushvalue(L, -1);
-    if (lua_pcall(L, 1, 0, 0)) {
+    if (luaK_callback_pcall(lc->server->lua, &lc->stats, 1, 0)) {
         wlr_log(WLR_ERROR, "%s", lua_tostring(L, -1));
     }
 
@@ -210,6 +770,7 @@ l_kiwmi_server_schedule(lua_State *L)
 
     lc->server       = server;
     lc->callback_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    luaK_callback_stats_init(&lc->stats, "schedule");
 
     wl_list_insert(&server->lua->scheduled_callbacks, &lc->link);
 
@@ -235,26 +796,64 @@ l_kiwmi_server_set_verbosity(lua_State *L)
     return 0;
 }
 
+static int
+l_kiwmi_server_sleep(lua_State *L)
+{
+    struct kiwmi_object *obj =
+        *(struct kiwmi_object **)luaL_checkudata(L, 1, "kiwmi_server");
+    luaL_checktype(L, 2, LUA_TNUMBER);
+
+    struct kiwmi_server *server = obj->object;
+
+    return luaK_sleep(L, server->lua, lua_tonumber(L, 2));
+}
+
 static int
 l_kiwmi_server_spawn(lua_State *L)
 {
-    luaL_checkudata(L, 1, "kiwmi_server");
+    struct kiwmi_object *obj =
+        *(struct kiwmi_object **)luaL_checkudata(L, 1, "kiwmi_server");
     luaL_checktype(L, 2, LUA_TSTRING);
 
+    struct kiwmi_server *server = obj->object;
+
     const char *command = lua_tostring(L, 2);
 
-    pid_t pid = fork();
+    pid_t pid = server_spawn(server, command);
 
     if (pid < 0) {
         return luaL_error(L, "Failed to run command (fork)");
     }
 
-    if (pid == 0) {
-        execl("/bin/sh", "/bin/sh", "-c", command, NULL);
-        _exit(EXIT_FAILURE);
+    lua_pushinteger(L, pid);
+
+    return 1;
+}
+
+static int
+l_kiwmi_server_spawn_async(lua_State *L)
+{
+    struct kiwmi_object *obj =
+        *(struct kiwmi_object **)luaL_checkudata(L, 1, "kiwmi_server");
+    luaL_checktype(L, 2, LUA_TSTRING);
+
+    struct kiwmi_server *server = obj->object;
+
+    const char *command = lua_tostring(L, 2);
+
+    pid_t pid = server_spawn(server, command);
+
+    if (pid < 0) {
+        return luaL_error(L, "Failed to run command (fork)");
     }
 
+    lua_pushcfunction(L, luaK_kiwmi_child_new);
+    lua_pushlightuserdata(L, server->lua);
     lua_pushinteger(L, pid);
+    if (lua_pcall(L, 2, 1, 0)) {
+        wlr_log(WLR_ERROR, "%s", lua_tostring(L, -1));
+        return 0;
+    }
 
     return 1;
 }
@@ -272,6 +871,41 @@ l_kiwmi_server_stop_interactive(lua_State *L)
     return 0;
 }
 
+static int
+l_kiwmi_server_transaction(lua_State *L)
+{
+    struct kiwmi_object *obj =
+        *(struct kiwmi_object **)luaL_checkudata(L, 1, "kiwmi_server");
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+
+    struct kiwmi_server *server = obj->object;
+
+    transaction_begin(&server->desktop);
+
+    lua_pushvalue(L, 2);
+    int error = lua_pcall(L, 0, 0, 0);
+
+    // Send whatever got recorded, even if the function failed midway.
+    transaction_commit(&server->desktop);
+
+    if (error) {
+        return lua_error(L);
+    }
+
+    return 0;
+}
+
+static int
+l_kiwmi_server_unbind(lua_State *L)
+{
+    struct kiwmi_object *obj =
+        *(struct kiwmi_object **)luaL_checkudata(L, 1, "kiwmi_server");
+
+    struct kiwmi_server *server = obj->object;
+
+    return luaK_kiwmi_keybind_unbind(L, &server->input.keybinds);
+}
+
 static int
 l_kiwmi_server_unfocus(lua_State *L)
 {
@@ -297,6 +931,47 @@ l_kiwmi_server_verbosity(lua_State *L)
     return 1;
 }
 
+static int
+l_kiwmi_server_wait(lua_State *L)
+{
+    struct kiwmi_object *obj =
+        *(struct kiwmi_object **)luaL_checkudata(L, 1, "kiwmi_server");
+
+    struct kiwmi_server *server = obj->object;
+
+    return luaK_wait(L, server->lua, 2, 3);
+}
+
+static int
+l_kiwmi_server_watchdog(lua_State *L)
+{
+    struct kiwmi_object *obj =
+        *(struct kiwmi_object **)luaL_checkudata(L, 1, "kiwmi_server");
+    luaL_checktype(L, 2, LUA_TNUMBER);
+
+    struct kiwmi_server *server = obj->object;
+
+    int ms = lua_tonumber(L, 2);
+    if (ms < 0) {
+        return luaL_argerror(L, 2, "must not be negative");
+    }
+
+    bool abort = false;
+    if (!lua_isnoneornil(L, 3)) {
+        const char *action = luaL_checkstring(L, 3);
+        if (strcmp(action, "abort") == 0) {
+            abort = true;
+        } else if (strcmp(action, "log") != 0) {
+            return luaL_argerror(L, 3, "expected \"log\" or \"abort\"");
+        }
+    }
+
+    server->lua->watchdog_ms    = ms;
+    server->lua->watchdog_abort = abort;
+
+    return 0;
+}
+
 static int
 l_kiwmi_server_view_at(lua_State *L)
 {
@@ -329,19 +1004,37 @@ l_kiwmi_server_view_at(lua_State *L)
 
 static const luaL_Reg kiwmi_server_methods[] = {
     {"active_output", l_kiwmi_server_active_output},
+    {"async", l_kiwmi_server_async},
     {"bg_color", l_kiwmi_server_bg_color},
+    {"bind", l_kiwmi_server_bind},
+    {"configure_outputs", l_kiwmi_server_configure_outputs},
+    {"create_output", l_kiwmi_server_create_output},
     {"cursor", l_kiwmi_server_cursor},
     {"focused_view", l_kiwmi_server_focused_view},
+    {"gc_budget", l_kiwmi_server_gc_budget},
+    {"gc_stats", l_kiwmi_server_gc_stats},
+    {"ipc_stats", l_kiwmi_server_ipc_stats},
+    {"occluded_frame_interval", l_kiwmi_server_occluded_frame_interval},
     {"on", luaK_callback_register_dispatch},
+    {"once", luaK_callback_register_once},
     {"output_at", l_kiwmi_server_output_at},
+    {"output_debounce", l_kiwmi_server_output_debounce},
+    {"profile", l_kiwmi_server_profile},
     {"quit", l_kiwmi_server_quit},
+    {"reload", l_kiwmi_server_reload},
     {"schedule", l_kiwmi_server_schedule},
     {"set_verbosity", l_kiwmi_server_set_verbosity},
+    {"sleep", l_kiwmi_server_sleep},
     {"spawn", l_kiwmi_server_spawn},
+    {"spawn_async", l_kiwmi_server_spawn_async},
     {"stop_interactive", l_kiwmi_server_stop_interactive},
+    {"transaction", l_kiwmi_server_transaction},
+    {"unbind", l_kiwmi_server_unbind},
     {"unfocus", l_kiwmi_server_unfocus},
     {"verbosity", l_kiwmi_server_verbosity},
     {"view_at", l_kiwmi_server_view_at},
+    {"wait", l_kiwmi_server_wait},
+    {"watchdog", l_kiwmi_server_watchdog},
     {NULL, NULL},
 };
 
@@ -353,6 +1046,10 @@ kiwmi_server_on_keyboard_notify(struct wl_listener *listener, void *data)
     lua_State *L                    = server->lua->L;
     struct kiwmi_keyboard *keyboard = data;
 
+    if (lc->dead) {
+        return;
+    }
+
     lua_rawgeti(L, LUA_REGISTRYINDEX, lc->callback_ref);
 
     lua_pushcfunction(L, luaK_kiwmi_keyboard_new);
@@ -364,7 +1061,7 @@ kiwmi_server_on_keyboard_notify(struct wl_listener *listener, void *data)
         return;
     }
 
-    if (lua_pcall(L, 1, 0, 0)) {
+    if (luaK_callback_pcall(lc->server->lua, &lc->stats, 1, 0)) {
         wlr_log(WLR_ERROR, "%s", lua_tostring(L, -1));
         lua_pop(L, 1);
     }
@@ -378,6 +1075,10 @@ kiwmi_server_on_output_notify(struct wl_listener *listener, void *data)
     lua_State *L                  = server->lua->L;
     struct kiwmi_output *output   = data;
 
+    if (lc->dead) {
+        return;
+    }
+
     lua_rawgeti(L, LUA_REGISTRYINDEX, lc->callback_ref);
 
     lua_pushcfunction(L, luaK_kiwmi_output_new);
@@ -389,7 +1090,74 @@ kiwmi_server_on_output_notify(struct wl_listener *listener, void *data)
         return;
     }
 
-    if (lua_pcall(L, 1, 0, 0)) {
+    if (luaK_callback_pcall(lc->server->lua, &lc->stats, 1, 0)) {
+        wlr_log(WLR_ERROR, "%s", lua_tostring(L, -1));
+        lua_pop(L, 1);
+    }
+}
+
+static void
+kiwmi_server_on_outputs_change_notify(struct wl_listener *listener, void *data)
+{
+    struct kiwmi_lua_callback *lc = wl_container_of(listener, lc, listener);
+    struct kiwmi_server *server   = lc->server;
+    lua_State *L                  = server->lua->L;
+    struct kiwmi_desktop *desktop = data;
+
+    if (lc->dead) {
+        return;
+    }
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, lc->callback_ref);
+
+    lua_newtable(L);
+
+    int i = 0;
+    struct kiwmi_output *output;
+    wl_list_for_each (output, &desktop->outputs, link) {
+        struct wlr_output *wlr_output = output->wlr_output;
+
+        lua_newtable(L);
+
+        lua_pushcfunction(L, luaK_kiwmi_output_new);
+        lua_pushlightuserdata(L, server->lua);
+        lua_pushlightuserdata(L, output);
+        if (lua_pcall(L, 2, 1, 0)) {
+            wlr_log(WLR_ERROR, "%s", lua_tostring(L, -1));
+            lua_pop(L, 4);
+            return;
+        }
+        lua_setfield(L, -2, "output");
+
+        lua_pushstring(L, wlr_output->name);
+        lua_setfield(L, -2, "name");
+
+        lua_pushboolean(L, wlr_output->enabled);
+        lua_setfield(L, -2, "enabled");
+
+        struct wlr_box *box =
+            wlr_output_layout_get_box(desktop->output_layout, wlr_output);
+        if (box) {
+            lua_pushinteger(L, box->x);
+            lua_setfield(L, -2, "x");
+
+            lua_pushinteger(L, box->y);
+            lua_setfield(L, -2, "y");
+        }
+
+        lua_pushinteger(L, wlr_output->width);
+        lua_setfield(L, -2, "width");
+
+        lua_pushinteger(L, wlr_output->height);
+        lua_setfield(L, -2, "height");
+
+        lua_pushnumber(L, wlr_output->scale);
+        lua_setfield(L, -2, "scale");
+
+        lua_rawseti(L, -2, ++i);
+    }
+
+    if (luaK_callback_pcall(lc->server->lua, &lc->stats, 1, 0)) {
         wlr_log(WLR_ERROR, "%s", lua_tostring(L, -1));
         lua_pop(L, 1);
     }
@@ -405,8 +1173,12 @@ kiwmi_server_on_request_active_output_notify(
     lua_State *L                  = server->lua->L;
     struct kiwmi_output **output  = data;
 
+    if (lc->dead) {
+        return;
+    }
+
     lua_rawgeti(L, LUA_REGISTRYINDEX, lc->callback_ref);
-    if (lua_pcall(L, 0, 1, 0)) {
+    if (luaK_callback_pcall(lc->server->lua, &lc->stats, 0, 1)) {
         wlr_log(WLR_ERROR, "%s", lua_tostring(L, -1));
         return;
     }
@@ -441,6 +1213,10 @@ kiwmi_server_on_view_notify(struct wl_listener *listener, void *data)
     lua_State *L                  = server->lua->L;
     struct kiwmi_view *view       = data;
 
+    if (lc->dead) {
+        return;
+    }
+
     lua_rawgeti(L, LUA_REGISTRYINDEX, lc->callback_ref);
 
     lua_pushcfunction(L, luaK_kiwmi_view_new);
@@ -452,7 +1228,7 @@ kiwmi_server_on_view_notify(struct wl_listener *listener, void *data)
         return;
     }
 
-    if (lua_pcall(L, 1, 0, 0)) {
+    if (luaK_callback_pcall(lc->server->lua, &lc->stats, 1, 0)) {
         wlr_log(WLR_ERROR, "%s", lua_tostring(L, -1));
         lua_pop(L, 1);
     }
@@ -506,6 +1282,30 @@ l_kiwmi_server_on_output(lua_State *L)
     return 0;
 }
 
+static int
+l_kiwmi_server_on_outputs_change(lua_State *L)
+{
+    struct kiwmi_object *obj =
+        *(struct kiwmi_object **)luaL_checkudata(L, 1, "kiwmi_server");
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+
+    struct kiwmi_server *server = obj->object;
+
+    lua_pushcfunction(L, luaK_kiwmi_lua_callback_new);
+    lua_pushlightuserdata(L, server);
+    lua_pushvalue(L, 2);
+    lua_pushlightuserdata(L, kiwmi_server_on_outputs_change_notify);
+    lua_pushlightuserdata(L, &server->desktop.events.outputs_change);
+    lua_pushlightuserdata(L, obj);
+
+    if (lua_pcall(L, 5, 0, 0)) {
+        wlr_log(WLR_ERROR, "%s", lua_tostring(L, -1));
+        return 0;
+    }
+
+    return 0;
+}
+
 static int
 l_kiwmi_server_on_request_active_output(lua_State *L)
 {
@@ -557,6 +1357,7 @@ l_kiwmi_server_on_view(lua_State *L)
 static const luaL_Reg kiwmi_server_events[] = {
     {"keyboard", l_kiwmi_server_on_keyboard},
     {"output", l_kiwmi_server_on_output},
+    {"outputs_change", l_kiwmi_server_on_outputs_change},
     {"request_active_output", l_kiwmi_server_on_request_active_output},
     {"view", l_kiwmi_server_on_view},
     {NULL, NULL},
@@ -571,14 +1372,8 @@ luaK_kiwmi_server_new(lua_State *L)
     struct kiwmi_lua *lua       = lua_touserdata(L, 1);
     struct kiwmi_server *server = lua_touserdata(L, 2);
 
-    struct kiwmi_object *obj =
-        luaK_get_kiwmi_object(lua, server, &server->events.destroy);
-
-    struct kiwmi_object **server_ud = lua_newuserdata(L, sizeof(*server_ud));
-    luaL_getmetatable(L, "kiwmi_server");
-    lua_setmetatable(L, -2);
-
-    *server_ud = obj;
+    luaK_push_kiwmi_object(
+        L, lua, server, &server->events.destroy, "kiwmi_server");
 
     return 1;
 }
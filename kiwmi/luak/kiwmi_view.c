@@ -7,6 +7,7 @@
 
 #include "luak/kiwmi_view.h"
 
+#include <stdio.h>
 #include <string.h>
 
 #include <lauxlib.h>
@@ -159,7 +160,10 @@ l_kiwmi_view_id(lua_State *L)
 
     struct kiwmi_view *view = obj->object;
 
-    lua_pushnumber(L, (lua_Number)(size_t)view);
+    // A string, since a lua_Number can't hold every pointer.
+    char id[32];
+    snprintf(id, sizeof(id), "%zu", (size_t)view);
+    lua_pushstring(L, id);
 
     return 1;
 }
@@ -228,6 +232,25 @@ l_kiwmi_view_iresize(lua_State *L)
     return 0;
 }
 
+static int
+l_kiwmi_view_latency_sensitive(lua_State *L)
+{
+    struct kiwmi_object *obj =
+        *(struct kiwmi_object **)luaL_checkudata(L, 1, "kiwmi_view");
+    luaL_checktype(L, 2, LUA_TBOOLEAN);
+
+    if (!obj->valid) {
+        return luaL_error(L, "kiwmi_view no longer valid");
+    }
+
+    struct kiwmi_view *view = obj->object;
+
+    view->latency_sensitive = lua_toboolean(L, 2);
+    view_update_latency_sensitive(view);
+
+    return 0;
+}
+
 static int
 l_kiwmi_view_move(lua_State *L)
 {
@@ -440,8 +463,10 @@ static const luaL_Reg kiwmi_view_methods[] = {
     {"id", l_kiwmi_view_id},
     {"imove", l_kiwmi_view_imove},
     {"iresize", l_kiwmi_view_iresize},
+    {"latency_sensitive", l_kiwmi_view_latency_sensitive},
     {"move", l_kiwmi_view_move},
     {"on", luaK_callback_register_dispatch},
+    {"once", luaK_callback_register_once},
     {"pid", l_kiwmi_view_pid},
     {"pos", l_kiwmi_view_pos},
     {"resize", l_kiwmi_view_resize},
@@ -460,6 +485,10 @@ kiwmi_view_on_destroy_notify(struct wl_listener *listener, void *data)
     lua_State *L                  = server->lua->L;
     struct kiwmi_view *view       = data;
 
+    if (lc->dead) {
+        return;
+    }
+
     lua_rawgeti(L, LUA_REGISTRYINDEX, lc->callback_ref);
 
     lua_pushcfunction(L, luaK_kiwmi_view_new);
@@ -472,7 +501,7 @@ kiwmi_view_on_destroy_notify(struct wl_listener *listener, void *data)
         return;
     }
 
-    if (lua_pcall(L, 1, 0, 0)) {
+    if (luaK_callback_pcall(lc->server->lua, &lc->stats, 1, 0)) {
         wlr_log(WLR_ERROR, "%s", lua_tostring(L, -1));
         lua_pop(L, 1);
     }
@@ -486,6 +515,10 @@ kiwmi_view_on_request_move_notify(struct wl_listener *listener, void *data)
     lua_State *L                  = server->lua->L;
     struct kiwmi_view *view       = data;
 
+    if (lc->dead) {
+        return;
+    }
+
     lua_rawgeti(L, LUA_REGISTRYINDEX, lc->callback_ref);
 
     lua_pushcfunction(L, luaK_kiwmi_view_new);
@@ -498,7 +531,7 @@ kiwmi_view_on_request_move_notify(struct wl_listener *listener, void *data)
         return;
     }
 
-    if (lua_pcall(L, 1, 0, 0)) {
+    if (luaK_callback_pcall(lc->server->lua, &lc->stats, 1, 0)) {
         wlr_log(WLR_ERROR, "%s", lua_tostring(L, -1));
         lua_pop(L, 1);
     }
@@ -511,6 +544,10 @@ kiwmi_view_on_request_resize_notify(struct wl_listener *listener, void *data)
     struct kiwmi_server *server   = lc->server;
     lua_State *L                  = server->lua->L;
 
+    if (lc->dead) {
+        return;
+    }
+
     struct kiwmi_request_resize_event *event = data;
     struct kiwmi_view *view                  = event->view;
 
@@ -555,7 +592,7 @@ kiwmi_view_on_request_resize_notify(struct wl_listener *listener, void *data)
 
     lua_setfield(L, -2, "edges");
 
-    if (lua_pcall(L, 1, 0, 0)) {
+    if (luaK_callback_pcall(lc->server->lua, &lc->stats, 1, 0)) {
         wlr_log(WLR_ERROR, "%s", lua_tostring(L, -1));
         lua_pop(L, 1);
     }
@@ -683,14 +720,7 @@ luaK_kiwmi_view_new(lua_State *L)
     struct kiwmi_lua *lua   = lua_touserdata(L, 1);
     struct kiwmi_view *view = lua_touserdata(L, 2);
 
-    struct kiwmi_object *obj =
-        luaK_get_kiwmi_object(lua, view, &view->events.unmap);
-
-    struct kiwmi_object **view_ud = lua_newuserdata(L, sizeof(*view_ud));
-    luaL_getmetatable(L, "kiwmi_view");
-    lua_setmetatable(L, -2);
-
-    *view_ud = obj;
+    luaK_push_kiwmi_object(L, lua, view, &view->events.unmap, "kiwmi_view");
 
     return 1;
 }
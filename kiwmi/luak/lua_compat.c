@@ -22,3 +22,40 @@ luaC_setfuncs(lua_State *L, const luaL_Reg *l, int nup)
     }
     lua_pop(L, nup);
 }
+
+int
+luaC_resume(lua_State *L, lua_State *from, int narg, int *nres)
+{
+#if LUA_VERSION_NUM >= 504
+    return lua_resume(L, from, narg, nres);
+#elif LUA_VERSION_NUM >= 502
+    int status = lua_resume(L, from, narg);
+    *nres      = lua_gettop(L);
+    return status;
+#else
+    (void)from;
+    int status = lua_resume(L, narg);
+    *nres      = lua_gettop(L);
+    return status;
+#endif
+}
+
+int
+luaC_dump(lua_State *L, lua_Writer writer, void *data)
+{
+#if LUA_VERSION_NUM >= 503
+    return lua_dump(L, writer, data, 0);
+#else
+    return lua_dump(L, writer, data);
+#endif
+}
+
+size_t
+luaC_rawlen(lua_State *L, int idx)
+{
+#if LUA_VERSION_NUM >= 502
+    return lua_rawlen(L, idx);
+#else
+    return lua_objlen(L, idx);
+#endif
+}
@@ -13,7 +13,15 @@
 #include <lualib.h>
 #include <wlr/util/log.h>
 
+#include "desktop/output.h"
+#include "desktop/view.h"
+#include "input/input.h"
+#include "input/keyboard.h"
+#include "luak/bytecode.h"
+#include "luak/coroutine.h"
+#include "luak/gc.h"
 #include "luak/ipc.h"
+#include "luak/kiwmi_child.h"
 #include "luak/kiwmi_cursor.h"
 #include "luak/kiwmi_keyboard.h"
 #include "luak/kiwmi_lua_callback.h"
@@ -38,9 +46,20 @@ luaK_toudata(lua_State *L, int ud, const char *tname)
     return NULL;
 }
 
+static uint64_t
+kiwmi_object_key(void *ptr)
+{
+    return (uintptr_t)ptr;
+}
+
 static void
 kiwmi_object_destroy(struct kiwmi_object *obj)
 {
+    // Invalid objects were already dropped from the registry.
+    if (obj->valid) {
+        hashmap_remove(&obj->lua->objects, kiwmi_object_key(obj->object));
+    }
+
     wl_list_remove(&obj->destroy.link);
     wl_list_remove(&obj->events.destroy.listener_list);
 
@@ -54,11 +73,17 @@ luaK_kiwmi_object_gc(lua_State *L)
 
     --obj->refcount;
 
+    luaK_kiwmi_object_release(obj);
+
+    return 0;
+}
+
+void
+luaK_kiwmi_object_release(struct kiwmi_object *obj)
+{
     if (obj->refcount == 0 && wl_list_empty(&obj->callbacks)) {
         kiwmi_object_destroy(obj);
     }
-
-    return 0;
 }
 
 static void
@@ -71,20 +96,18 @@ kiwmi_object_destroy_notify(struct wl_listener *listener, void *data)
     struct kiwmi_lua_callback *lc;
     struct kiwmi_lua_callback *tmp;
     wl_list_for_each_safe (lc, tmp, &obj->callbacks, link) {
-        wl_list_remove(&lc->listener.link);
-        wl_list_remove(&lc->link);
-
-        luaL_unref(lc->server->lua->L, LUA_REGISTRYINDEX, lc->callback_ref);
-
-        free(lc);
+        luaK_callback_destroy(obj->lua, lc);
     }
 
+    hashmap_remove(&obj->lua->objects, kiwmi_object_key(obj->object));
+
     lua_State *L = obj->lua->L;
 
-    lua_rawgeti(L, LUA_REGISTRYINDEX, obj->lua->objects);
+    // The address might get reused by a new object.
+    lua_rawgeti(L, LUA_REGISTRYINDEX, obj->lua->userdata);
     lua_pushlightuserdata(L, obj->object);
     lua_pushnil(L);
-    lua_settable(L, -3);
+    lua_rawset(L, -3);
     lua_pop(L, 1);
 
     obj->valid = false;
@@ -100,16 +123,8 @@ luaK_get_kiwmi_object(
     void *ptr,
     struct wl_signal *destroy)
 {
-    lua_State *L = lua->L;
-
-    lua_rawgeti(L, LUA_REGISTRYINDEX, lua->objects);
-    lua_pushlightuserdata(L, ptr);
-    lua_gettable(L, -2);
-
-    struct kiwmi_object *obj = lua_touserdata(L, -1);
-
-    lua_pop(L, 2);
-
+    struct kiwmi_object *obj =
+        hashmap_get(&lua->objects, kiwmi_object_key(ptr));
     if (obj) {
         ++obj->refcount;
         return obj;
@@ -121,6 +136,12 @@ luaK_get_kiwmi_object(
         return NULL;
     }
 
+    if (!hashmap_insert(&lua->objects, kiwmi_object_key(ptr), obj)) {
+        wlr_log(WLR_ERROR, "Failed to register kiwmi_object");
+        free(obj);
+        return NULL;
+    }
+
     obj->lua      = lua;
     obj->object   = ptr;
     obj->refcount = 1;
@@ -137,12 +158,47 @@ luaK_get_kiwmi_object(
 
     wl_list_init(&obj->callbacks);
 
-    lua_rawgeti(L, LUA_REGISTRYINDEX, lua->objects);
+    return obj;
+}
+
+void
+luaK_push_kiwmi_object(
+    lua_State *L,
+    struct kiwmi_lua *lua,
+    void *ptr,
+    struct wl_signal *destroy,
+    const char *tname)
+{
+    lua_rawgeti(L, LUA_REGISTRYINDEX, lua->userdata);
     lua_pushlightuserdata(L, ptr);
-    lua_pushlightuserdata(L, obj);
-    lua_settable(L, -3);
+    lua_rawget(L, -2);
 
-    return obj;
+    // Reuse the userdata as long as Lua holds on to it.
+    if (!lua_isnil(L, -1)) {
+        lua_remove(L, -2);
+        return;
+    }
+
+    lua_pop(L, 1);
+
+    struct kiwmi_object *obj = luaK_get_kiwmi_object(lua, ptr, destroy);
+    if (!obj) {
+        lua_pop(L, 1);
+        luaL_error(L, "failed to create %s", tname);
+        return;
+    }
+
+    struct kiwmi_object **ud = lua_newuserdata(L, sizeof(*ud));
+    luaL_getmetatable(L, tname);
+    lua_setmetatable(L, -2);
+
+    *ud = obj;
+
+    lua_pushlightuserdata(L, ptr);
+    lua_pushvalue(L, -2);
+    lua_rawset(L, -4);
+
+    lua_remove(L, -2);
 }
 
 int
@@ -163,11 +219,69 @@ luaK_callback_register_dispatch(lua_State *L)
     lua_pushvalue(L, 1);
     lua_pushvalue(L, 3);
 
+    struct kiwmi_object *obj = *(struct kiwmi_object **)lua_touserdata(L, 1);
+    struct wl_list *first    = obj->callbacks.next;
+
     if (lua_pcall(L, 2, 1, 0)) {
         wlr_log(WLR_ERROR, "%s", lua_tostring(L, -1));
         return 0;
     }
 
+    // Name the new callback after its event for kiwmi:profile().
+    if (obj->callbacks.next != first) {
+        struct kiwmi_lua_callback *lc =
+            wl_container_of(obj->callbacks.next, lc, link);
+        luaK_callback_stats_init(&lc->stats, lua_tostring(L, 2));
+
+        lua_pop(L, 1);
+        luaK_callback_push_handle(L, lc);
+    }
+
+    return 1;
+}
+
+static int
+callback_once(lua_State *L)
+{
+    struct kiwmi_lua_callback **handle =
+        lua_touserdata(L, lua_upvalueindex(2));
+
+    // Remove it first, so it's gone even if the callback fails.
+    if (handle && *handle) {
+        struct kiwmi_lua_callback *lc = *handle;
+        luaK_callback_free(lc->server->lua, lc);
+    }
+
+    lua_pushvalue(L, lua_upvalueindex(1));
+    lua_insert(L, 1);
+    lua_call(L, lua_gettop(L) - 1, LUA_MULTRET);
+
+    return lua_gettop(L);
+}
+
+int
+luaK_callback_register_once(lua_State *L)
+{
+    luaL_checktype(L, 1, LUA_TUSERDATA); // object
+    luaL_checktype(L, 2, LUA_TSTRING);   // type
+    luaL_checktype(L, 3, LUA_TFUNCTION); // callback
+
+    lua_settop(L, 3);
+
+    lua_pushvalue(L, 3);
+    lua_pushnil(L); // the handle, set once it exists
+    lua_pushcclosure(L, callback_once, 2);
+    lua_replace(L, 3);
+
+    if (!luaK_callback_register_dispatch(L)) {
+        return 0;
+    }
+
+    if (!lua_isnil(L, -1)) {
+        lua_pushvalue(L, -1);
+        lua_setupvalue(L, 3, 2);
+    }
+
     return 1;
 }
 
@@ -185,6 +299,84 @@ luaK_usertype_ref_equal(lua_State *L)
     return 1;
 }
 
+static void
+kiwmi_object_detach(struct kiwmi_object *obj)
+{
+    struct kiwmi_lua_callback *lc;
+    struct kiwmi_lua_callback *tmp;
+    wl_list_for_each_safe (lc, tmp, &obj->callbacks, link) {
+        luaK_callback_destroy(obj->lua, lc);
+    }
+
+    wl_list_remove(&obj->destroy.link);
+    wl_list_init(&obj->destroy.link);
+
+    obj->valid = false;
+
+    if (obj->refcount == 0) {
+        kiwmi_object_destroy(obj);
+    }
+}
+
+void
+luaK_userdata_cache_init(struct kiwmi_lua *lua)
+{
+    lua_State *L = lua->L;
+
+    // weak, so unused userdata still gets collected
+    lua_newtable(L);
+    lua_newtable(L);
+    lua_pushstring(L, "v");
+    lua_setfield(L, -2, "__mode");
+    lua_setmetatable(L, -2);
+    lua->userdata = luaL_ref(L, LUA_REGISTRYINDEX);
+}
+
+// Frees everything luaK_create() set up, also a partially created state.
+static void
+lua_free(struct kiwmi_lua *lua)
+{
+    luaK_gc_fini(lua);
+    luaK_waiters_destroy(lua);
+    wl_list_remove(&lua->child_exit.link);
+
+    if (lua->reload_idle) {
+        wl_event_source_remove(lua->reload_idle);
+    }
+
+    if (lua->global) {
+        wl_global_destroy(lua->global);
+    }
+
+    // Unhook every object, so nothing calls into the state once it's closed.
+    for (size_t i = 0; i < lua->objects.capacity; ++i) {
+        struct kiwmi_object *obj = lua->objects.entries[i].value;
+        if (obj) {
+            kiwmi_object_detach(obj);
+        }
+    }
+
+    struct kiwmi_lua_callback *lc;
+    struct kiwmi_lua_callback *tmp;
+    wl_list_for_each_safe (lc, tmp, &lua->scheduled_callbacks, link) {
+        wl_event_source_remove(lc->event_source);
+        wl_list_remove(&lc->link);
+        free(lc);
+    }
+
+    // every dead callback went away along with its object
+    if (lua->dead_callbacks_idle) {
+        wl_event_source_remove(lua->dead_callbacks_idle);
+    }
+
+    lua_close(lua->L);
+
+    hashmap_fini(&lua->objects);
+    luaK_chunk_cache_fini(&lua->chunk_cache);
+
+    free(lua);
+}
+
 struct kiwmi_lua *
 luaK_create(struct kiwmi_server *server)
 {
@@ -200,23 +392,47 @@ luaK_create(struct kiwmi_server *server)
         return NULL;
     }
 
-    lua->L = L;
+    lua->L      = L;
+    lua->server = server;
 
     luaL_openlibs(L);
 
     wl_list_init(&lua->scheduled_callbacks);
+    wl_list_init(&lua->dead_callbacks);
+    wl_list_init(&lua->waiters);
+    wl_list_init(&lua->children);
 
-    // init object registry
-    lua_newtable(L);
-    lua->objects = luaL_ref(L, LUA_REGISTRYINDEX);
+    lua->watchdog_ms         = 0;
+    lua->watchdog_abort      = false;
+    lua->watchdog_fired      = false;
+    lua->callback_start_nsec = 0;
+    lua->calls               = NULL;
+    lua->reload_idle         = NULL;
+    lua->global              = NULL;
+    lua->dead_callbacks_idle = NULL;
+
+    wl_list_init(&lua->child_exit.link);
+
+    luaK_gc_init(lua, server->wl_event_loop);
+    luaK_watchdog_init(lua);
+
+    hashmap_init(&lua->objects);
+    luaK_chunk_cache_init(&lua->chunk_cache);
+    lua->ipc_stats = (struct kiwmi_ipc_stats){0};
+
+    luaK_userdata_cache_init(lua);
 
     // register types
     int error = 0;
 
+    lua_pushcfunction(L, luaK_kiwmi_child_register);
+    error |= lua_pcall(L, 0, 0, 0);
     lua_pushcfunction(L, luaK_kiwmi_cursor_register);
     error |= lua_pcall(L, 0, 0, 0);
     lua_pushcfunction(L, luaK_kiwmi_keyboard_register);
     error |= lua_pcall(L, 0, 0, 0);
+    lua_pushcfunction(L, luaK_kiwmi_lua_callback_register);
+    error |= lua_pcall(L, 0, 0, 0);
     lua_pushcfunction(L, luaK_kiwmi_output_register);
     error |= lua_pcall(L, 0, 0, 0);
     lua_pushcfunction(L, luaK_kiwmi_server_register);
@@ -226,7 +442,7 @@ luaK_create(struct kiwmi_server *server)
 
     if (error) {
         wlr_log(WLR_ERROR, "%s", lua_tostring(L, -1));
-        lua_close(L);
+        lua_free(lua);
         return NULL;
     }
 
@@ -240,8 +456,7 @@ luaK_create(struct kiwmi_server *server)
     lua_pushlightuserdata(L, server);
     if (lua_pcall(L, 2, 1, 0)) {
         wlr_log(WLR_ERROR, "%s", lua_tostring(L, -1));
-        lua_close(L);
-        free(lua);
+        lua_free(lua);
         return NULL;
     }
     lua_setglobal(L, "kiwmi");
@@ -249,8 +464,7 @@ luaK_create(struct kiwmi_server *server)
     char *config_path = malloc(PATH_MAX);
     if (!config_path) {
         wlr_log(WLR_ERROR, "Failed to allocate memory");
-        lua_close(L);
-        free(lua);
+        lua_free(lua);
         return NULL;
     }
 
@@ -272,18 +486,21 @@ luaK_create(struct kiwmi_server *server)
     if (luaL_dostring(L, adjust_package_path)) {
         // shouldn't fail
         wlr_log(WLR_ERROR, "Error in adjust_package_path");
-        lua_close(L);
-        free(lua);
+        lua_free(lua);
         return NULL;
     }
 
+    luaK_bytecode_install_searcher(L);
+
     if (!luaK_ipc_init(server, lua)) {
         wlr_log(WLR_ERROR, "Failed to initialize IPC");
-        lua_close(L);
-        free(lua);
+        lua_free(lua);
         return NULL;
     }
 
+    lua->child_exit.notify = luaK_kiwmi_child_exit_notify;
+    wl_signal_add(&server->events.child_exit, &lua->child_exit);
+
     return lua;
 }
 
@@ -292,7 +509,8 @@ luaK_dofile(struct kiwmi_lua *lua, const char *config_path)
 {
     int top = lua_gettop(lua->L);
 
-    if (luaL_dofile(lua->L, config_path)) {
+    if (luaK_loadfile_cached(lua->L, config_path)
+        || lua_pcall(lua->L, 0, LUA_MULTRET, 0)) {
         wlr_log(
             WLR_ERROR, "Error running config: %s", lua_tostring(lua->L, -1));
         return false;
@@ -306,15 +524,84 @@ luaK_dofile(struct kiwmi_lua *lua, const char *config_path)
 void
 luaK_destroy(struct kiwmi_lua *lua)
 {
-    lua_close(lua->L);
+    struct kiwmi_server *server = lua->server;
 
-    struct kiwmi_lua_callback *lc;
-    struct kiwmi_lua_callback *tmp;
-    wl_list_for_each_safe (lc, tmp, &lua->scheduled_callbacks, link) {
-        wl_event_source_remove(lc->event_source);
-        wl_list_remove(&lc->link);
-        free(lc);
+    // Keybinds hold references into the state, drop them while it's alive.
+    keybinds_clear(&server->input.keybinds);
+    struct kiwmi_keyboard *keyboard;
+    wl_list_for_each (keyboard, &server->input.keyboards, link) {
+        keybinds_clear(&keyboard->keybinds);
     }
 
-    free(lua);
+    lua_free(lua);
+}
+
+static void
+reload_announce(struct kiwmi_server *server)
+{
+    struct kiwmi_desktop *desktop = &server->desktop;
+
+    struct kiwmi_output *output;
+    struct kiwmi_output *tmp_output;
+    wl_list_for_each_safe (output, tmp_output, &desktop->outputs, link) {
+        wl_signal_emit(&desktop->events.new_output, output);
+    }
+
+    struct kiwmi_keyboard *keyboard;
+    struct kiwmi_keyboard *tmp_keyboard;
+    wl_list_for_each_safe (
+        keyboard, tmp_keyboard, &server->input.keyboards, link) {
+        wl_signal_emit(&server->input.events.keyboard_new, keyboard);
+    }
+
+    // The config may restack views while handling them, so take a snapshot
+    // first. Bottom to top, so the focused view ends up on top again.
+    size_t count = wl_list_length(&desktop->views);
+    if (count == 0) {
+        return;
+    }
+
+    struct kiwmi_view **views = calloc(count, sizeof(*views));
+    if (!views) {
+        wlr_log(WLR_ERROR, "Failed to allocate memory");
+        return;
+    }
+
+    size_t i = 0;
+    struct kiwmi_view *view;
+    wl_list_for_each_reverse (view, &desktop->views, link) {
+        if (view->mapped) {
+            views[i++] = view;
+        }
+    }
+
+    for (size_t j = 0; j < i; ++j) {
+        wl_signal_emit(&desktop->events.view_map, views[j]);
+    }
+
+    free(views);
+}
+
+bool
+luaK_reload(struct kiwmi_server *server)
+{
+    wlr_log(WLR_INFO, "Reloading config");
+
+    // Keep the old state around until there is a new one to replace it, so
+    // server->lua is never NULL.
+    struct kiwmi_lua *lua = luaK_create(server);
+    if (!lua) {
+        wlr_log(WLR_ERROR, "Failed to reinitialize Lua, keeping old config");
+        return false;
+    }
+
+    luaK_destroy(server->lua);
+    server->lua = lua;
+
+    // A broken config still leaves a usable state to reload from again.
+    bool ok = luaK_dofile(server->lua, server->config_path);
+
+    reload_announce(server);
+
+    return ok;
 }
@@ -71,13 +71,18 @@ main(int argc, char **argv)
 
     fprintf(stderr, "Using kiwmi v" KIWMI_VERSION "\n");
 
-    signal(SIGCHLD, SIG_IGN); // prevent zombies from kiwmi:spawn()
-
     if (!getenv("XDG_RUNTIME_DIR")) {
         wlr_log(WLR_ERROR, "XDG_RUNTIME_DIR not set");
         exit(EXIT_FAILURE);
     }
 
+    // Threads started later (e.g. by the renderer) inherit the mask, so
+    // SIGCHLD only ever reaches the signalfd of the event loop.
+    sigset_t sigchld;
+    sigemptyset(&sigchld);
+    sigaddset(&sigchld, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &sigchld, NULL);
+
     struct kiwmi_server server;
 
     if (!server_init(&server, config_path)) {
@@ -11,9 +11,14 @@
 #include <stdlib.h>
 
 #include <limits.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include <wayland-server.h>
 #include <wlr/backend.h>
+#include <wlr/backend/headless.h>
+#include <wlr/backend/multi.h>
 #include <wlr/render/allocator.h>
 #include <wlr/render/wlr_renderer.h>
 #include <wlr/types/wlr_data_control_v1.h>
@@ -25,6 +30,33 @@
 
 #include "luak/luak.h"
 
+static int
+server_sigchld_notify(int UNUSED(signal_number), void *data)
+{
+    struct kiwmi_server *server = data;
+
+    struct kiwmi_server_child *child;
+    struct kiwmi_server_child *tmp;
+    wl_list_for_each_safe (child, tmp, &server->children, link) {
+        int status;
+        if (waitpid(child->pid, &status, WNOHANG) <= 0) {
+            continue;
+        }
+
+        struct kiwmi_child_exit_event event = {
+            .pid    = child->pid,
+            .status = status,
+        };
+
+        wl_list_remove(&child->link);
+        free(child);
+
+        wl_signal_emit(&server->events.child_exit, &event);
+    }
+
+    return 0;
+}
+
 bool
 server_init(struct kiwmi_server *server, char *config_path)
 {
@@ -38,6 +70,21 @@ server_init(struct kiwmi_server *server, char *config_path)
 
     server->wl_event_loop = wl_display_get_event_loop(server->wl_display);
 
+    wl_list_init(&server->event_streams);
+    server->ipc_resources = 0;
+    wl_list_init(&server->children);
+
+    wl_signal_init(&server->events.child_exit);
+
+    // SIGCHLD is blocked in main(), before any thread could start.
+    server->sigchld = wl_event_loop_add_signal(
+        server->wl_event_loop, SIGCHLD, server_sigchld_notify, server);
+    if (!server->sigchld) {
+        wlr_log(WLR_ERROR, "Failed to add SIGCHLD handler");
+        wl_display_destroy(server->wl_display);
+        return false;
+    }
+
     server->backend = wlr_backend_autocreate(server->wl_display);
     if (!server->backend) {
         wlr_log(WLR_ERROR, "Failed to create backend");
@@ -45,6 +92,14 @@ server_init(struct kiwmi_server *server, char *config_path)
         return false;
     }
 
+    server->headless_backend = wlr_headless_backend_create(server->wl_display);
+    if (!server->headless_backend
+        || !wlr_multi_backend_add(server->backend, server->headless_backend)) {
+        wlr_log(WLR_ERROR, "Failed to create headless backend");
+        wl_display_destroy(server->wl_display);
+        return false;
+    }
+
     server->renderer = wlr_renderer_autocreate(server->backend);
     wlr_renderer_init_wl_display(server->renderer, server->wl_display);
 
@@ -144,12 +199,57 @@ server_fini(struct kiwmi_server *server)
 
     wl_display_destroy_clients(server->wl_display);
 
+    if (server->lua) {
+        luaK_destroy(server->lua);
+    }
+
     desktop_fini(&server->desktop);
     input_fini(&server->input);
 
-    wl_display_destroy(server->wl_display);
+    wl_event_source_remove(server->sigchld);
 
-    luaK_destroy(server->lua);
+    struct kiwmi_server_child *child;
+    struct kiwmi_server_child *tmp;
+    wl_list_for_each_safe (child, tmp, &server->children, link) {
+        wl_list_remove(&child->link);
+        free(child);
+    }
+
+    wl_display_destroy(server->wl_display);
 
     free(server->config_path);
 }
+
+pid_t
+server_spawn(struct kiwmi_server *server, const char *command)
+{
+    struct kiwmi_server_child *child = malloc(sizeof(*child));
+    if (!child) {
+        wlr_log(WLR_ERROR, "Failed to allocate kiwmi_server_child");
+        return -1;
+    }
+
+    pid_t pid = fork();
+
+    if (pid == 0) {
+        // SIGCHLD is blocked for the signalfd of the event loop.
+        sigset_t set;
+        sigemptyset(&set);
+        sigprocmask(SIG_SETMASK, &set, NULL);
+
+        execl("/bin/sh", "/bin/sh", "-c", command, NULL);
+        _exit(EXIT_FAILURE);
+    }
+
+    if (pid < 0) {
+        free(child);
+        return -1;
+    }
+
+    // SIGCHLD stays pending until the event loop runs again, so an early
+    // exit can't be missed.
+    child->pid = pid;
+    wl_list_insert(&server->children, &child->link);
+
+    return pid;
+}
@@ -5,52 +5,233 @@
  * You can obtain one at https://mozilla.org/MPL/2.0/.
  */
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <getopt.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+
 #include <wayland-client.h>
 
 #include "kiwmi-ipc-client-protocol.h"
 
+// Commands in flight at once in batch mode, bounds the buffered replies.
+#define BATCH_WINDOW 256
+// kiwmi queues the replies of every command it read in one go, they have to
+// fit into the socket buffer together. Each command in flight is assumed to
+// get a reply as large as the largest one so far, at least BATCH_REPLY_MIN.
+#define BATCH_REPLY_BUDGET (128 * 1024)
+#define BATCH_REPLY_MIN 2048
+
+struct command_reply {
+    bool done;
+    uint32_t error;
+    struct wl_array message; // every chunk and the final message
+};
+
+struct batch_command {
+    struct kiwmi_command *command;
+    struct command_reply reply;
+};
+
+struct bench_connection {
+    struct wl_display *display;
+    struct kiwmi_ipc *ipc;
+    struct kiwmi_command *command; // in flight, NULL when idle
+    struct command_reply reply;
+    uint64_t start_nsec;
+};
+
 static void
-command_done(
-    void *data,
-    struct kiwmi_command *UNUSED(kiwmi_command),
-    uint32_t error,
-    const char *message)
+command_reply_init(struct command_reply *reply)
 {
-    int *exit_code = data;
+    reply->done  = false;
+    reply->error = KIWMI_COMMAND_ERROR_SUCCESS;
+    wl_array_init(&reply->message);
+}
+
+static int
+command_print(struct command_reply *reply)
+{
+    int exit_code;
     FILE *out;
 
-    if (error == KIWMI_COMMAND_ERROR_SUCCESS) {
-        *exit_code = EXIT_SUCCESS;
-        out        = stdout;
+    if (reply->error == KIWMI_COMMAND_ERROR_SUCCESS) {
+        exit_code = EXIT_SUCCESS;
+        out       = stdout;
     } else {
-        *exit_code = EXIT_FAILURE;
-        out        = stderr;
+        exit_code = EXIT_FAILURE;
+        out       = stderr;
     }
 
+    const char *message = reply->message.size > 0 ? reply->message.data : "";
     if (message[0] != '\0') {
         fprintf(out, "%s\n", message);
     }
+
+    return exit_code;
+}
+
+static void
+command_append(struct command_reply *reply, const char *data, size_t len)
+{
+    char *dst = wl_array_add(&reply->message, len);
+    if (dst) {
+        memcpy(dst, data, len);
+    }
+}
+
+static void
+command_chunk(
+    void *data,
+    struct kiwmi_command *UNUSED(kiwmi_command),
+    const char *chunk)
+{
+    struct command_reply *reply = data;
+
+    command_append(reply, chunk, strlen(chunk));
+}
+
+static void
+command_done(
+    void *data,
+    struct kiwmi_command *UNUSED(kiwmi_command),
+    uint32_t error,
+    const char *message)
+{
+    struct command_reply *reply = data;
+
+    // including the NUL
+    command_append(reply, message, strlen(message) + 1);
+
+    reply->done  = true;
+    reply->error = error;
 }
 
 static const struct kiwmi_command_listener command_listener = {
-    .done = command_done,
+    .chunk = command_chunk,
+    .done  = command_done,
 };
 
+static struct kiwmi_command *
+command_send(struct kiwmi_ipc *ipc, const char *eval, bool json)
+{
+    if (json) {
+        return kiwmi_ipc_eval_json(ipc, eval);
+    }
+
+    return kiwmi_ipc_eval(ipc, eval);
+}
+
+// Runs every line of in as a command over a single connection. Commands are
+// sent without waiting for the replies of the previous ones, the replies are
+// still printed in order.
+static int
+batch_run(
+    struct wl_display *display,
+    struct kiwmi_ipc *ipc,
+    FILE *in,
+    bool json)
+{
+    struct batch_command commands[BATCH_WINDOW]; // ring buffer
+    size_t head = 0;                             // next reply to print
+    size_t tail = 0;                             // next command to send
+
+    // Somebody typing wants to see each reply before entering the next line.
+    size_t window = isatty(fileno(in)) ? 1 : BATCH_WINDOW;
+    size_t reply_estimate = BATCH_REPLY_MIN;
+
+    int exit_code    = EXIT_SUCCESS;
+    bool eof         = false;
+    char *line       = NULL;
+    size_t line_size = 0;
+
+    while (!eof || head != tail) {
+        while (!eof && tail - head < window
+               && (head == tail
+                   || (tail - head + 1) * reply_estimate
+                          <= BATCH_REPLY_BUDGET)) {
+            ssize_t len = getline(&line, &line_size, in);
+            if (len == -1) {
+                eof = true;
+                break;
+            }
+
+            if (len > 0 && line[len - 1] == '\n') {
+                line[len - 1] = '\0';
+            }
+
+            if (line[0] == '\0') {
+                continue;
+            }
+
+            struct batch_command *batch_command =
+                &commands[tail++ % BATCH_WINDOW];
+
+            command_reply_init(&batch_command->reply);
+            batch_command->command = command_send(ipc, line, json);
+            kiwmi_command_add_listener(
+                batch_command->command,
+                &command_listener,
+                &batch_command->reply);
+
+            wl_display_flush(display);
+        }
+
+        if (head == tail) {
+            continue;
+        }
+
+        // The replies of later commands get buffered in the meantime.
+        while (!commands[head % BATCH_WINDOW].reply.done) {
+            if (wl_display_dispatch(display) == -1) {
+                fprintf(stderr, "Lost connection to kiwmi\n");
+                free(line);
+                return EXIT_FAILURE;
+            }
+        }
+
+        while (head != tail && commands[head % BATCH_WINDOW].reply.done) {
+            struct batch_command *batch_command =
+                &commands[head++ % BATCH_WINDOW];
+
+            if (command_print(&batch_command->reply) != EXIT_SUCCESS) {
+                exit_code = EXIT_FAILURE;
+            }
+
+            if (batch_command->reply.message.size > reply_estimate) {
+                reply_estimate = batch_command->reply.message.size;
+            }
+
+            wl_array_release(&batch_command->reply.message);
+            kiwmi_command_destroy(batch_command->command);
+        }
+    }
+
+    fflush(stdout);
+    free(line);
+
+    return exit_code;
+}
+
 static void
 registry_global(
     void *data,
     struct wl_registry *registry,
     uint32_t name,
     const char *interface,
-    uint32_t UNUSED(version))
+    uint32_t version)
 {
     struct kiwmi_ipc **ipc = data;
     if (strcmp(interface, kiwmi_ipc_interface.name) == 0) {
-        *ipc = wl_registry_bind(registry, name, &kiwmi_ipc_interface, 1);
+        uint32_t bind_version = version < 4 ? version : 4;
+        *ipc = wl_registry_bind(
+            registry, name, &kiwmi_ipc_interface, bind_version);
     }
 }
 
@@ -68,36 +249,578 @@ static const struct wl_registry_listener registry_listener = {
     .global_remove = registry_global_remove,
 };
 
+static bool
+ipc_connect(struct wl_display **display, struct kiwmi_ipc **ipc)
+{
+    *display = wl_display_connect(NULL);
+    if (!*display) {
+        fprintf(stderr, "Failed to connect to display\n");
+        return false;
+    }
+
+    struct wl_registry *registry = wl_display_get_registry(*display);
+    *ipc                         = NULL;
+
+    wl_registry_add_listener(registry, &registry_listener, ipc);
+    wl_display_roundtrip(*display);
+
+    if (!*ipc) {
+        fprintf(stderr, "Failed to bind to kiwmi_ipc\n");
+        wl_display_disconnect(*display);
+        return false;
+    }
+
+    return true;
+}
+
+static uint64_t
+now_nsec(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static int
+latency_compare(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+// nearest-rank percentile of the sorted latencies
+static double
+latency_percentile(const uint64_t *latencies, size_t count, size_t percent)
+{
+    size_t rank = (count * percent + 99) / 100;
+    return latencies[rank > 0 ? rank - 1 : 0] / 1e6;
+}
+
+static void
+bench_send(struct bench_connection *conn, const char *eval, bool json)
+{
+    command_reply_init(&conn->reply);
+
+    conn->start_nsec = now_nsec();
+    conn->command    = command_send(conn->ipc, eval, json);
+    kiwmi_command_add_listener(conn->command, &command_listener, &conn->reply);
+
+    wl_display_flush(conn->display);
+}
+
+// Every connection keeps exactly one command in flight, so the latency of a
+// command isn't hidden behind the ones queued before it.
+static bool
+bench_loop(
+    struct bench_connection *conns,
+    size_t parallel,
+    const char *eval,
+    bool json,
+    uint64_t *latencies,
+    size_t count,
+    size_t *failures)
+{
+    struct pollfd *fds = calloc(parallel, sizeof(*fds));
+    if (!fds) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        return false;
+    }
+
+    size_t sent      = 0;
+    size_t completed = 0;
+
+    while (completed < count) {
+        bool ready = false;
+
+        for (size_t i = 0; i < parallel; ++i) {
+            struct bench_connection *conn = &conns[i];
+
+            if (!conn->command && sent < count) {
+                bench_send(conn, eval, json);
+                ++sent;
+            }
+
+            while (wl_display_prepare_read(conn->display) != 0) {
+                wl_display_dispatch_pending(conn->display);
+            }
+            wl_display_flush(conn->display);
+
+            fds[i].fd     = wl_display_get_fd(conn->display);
+            fds[i].events = POLLIN;
+
+            if (conn->command && conn->reply.done) {
+                ready = true;
+            }
+        }
+
+        // Don't block if a reply already came in while preparing the reads.
+        int n = poll(fds, parallel, ready ? 0 : -1);
+
+        bool lost = false;
+        for (size_t i = 0; i < parallel; ++i) {
+            struct bench_connection *conn = &conns[i];
+
+            if (n > 0 && (fds[i].revents & (POLLIN | POLLERR | POLLHUP))) {
+                if (wl_display_read_events(conn->display) == -1) {
+                    lost = true;
+                }
+            } else {
+                wl_display_cancel_read(conn->display);
+            }
+
+            if (wl_display_dispatch_pending(conn->display) == -1) {
+                lost = true;
+            }
+
+            if (!conn->command || !conn->reply.done) {
+                continue;
+            }
+
+            latencies[completed++] = now_nsec() - conn->start_nsec;
+
+            if (conn->reply.error != KIWMI_COMMAND_ERROR_SUCCESS) {
+                // one error message is enough to see what's wrong
+                if ((*failures)++ == 0) {
+                    command_print(&conn->reply);
+                }
+            }
+
+            wl_array_release(&conn->reply.message);
+            kiwmi_command_destroy(conn->command);
+            conn->command = NULL;
+        }
+
+        if (lost || n == -1) {
+            fprintf(stderr, "Lost connection to kiwmi\n");
+            free(fds);
+            return false;
+        }
+    }
+
+    free(fds);
+
+    return true;
+}
+
+// How many IPC resources kiwmi holds, or -1 if it can't tell.
+static long
+bench_resources(struct bench_connection *conn)
+{
+    struct command_reply reply;
+    command_reply_init(&reply);
+
+    struct kiwmi_command *command = kiwmi_ipc_eval(
+        conn->ipc, "return kiwmi:ipc_stats().resources or -1");
+    kiwmi_command_add_listener(command, &command_listener, &reply);
+    wl_display_roundtrip(conn->display);
+    kiwmi_command_destroy(command);
+
+    long resources = -1;
+    if (reply.done && reply.error == KIWMI_COMMAND_ERROR_SUCCESS) {
+        resources = strtol(reply.message.data, NULL, 10);
+    }
+
+    wl_array_release(&reply.message);
+
+    return resources;
+}
+
+// Runs eval count times over parallel connections and prints the latency
+// percentiles and the throughput. Also reports if kiwmi holds more IPC
+// resources afterwards.
+static int
+bench_run(const char *eval, bool json, size_t count, size_t parallel)
+{
+    struct bench_connection *conns = calloc(parallel, sizeof(*conns));
+    uint64_t *latencies            = calloc(count, sizeof(*latencies));
+    if (!conns || !latencies) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < parallel; ++i) {
+        if (!ipc_connect(&conns[i].display, &conns[i].ipc)) {
+            exit(EXIT_FAILURE);
+        }
+
+        if (json && kiwmi_ipc_get_version(conns[i].ipc) < 4) {
+            fprintf(stderr, "kiwmi doesn't support JSON results\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    long resources_before = bench_resources(&conns[0]);
+
+    size_t failures     = 0;
+    uint64_t start_nsec = now_nsec();
+
+    if (!bench_loop(conns, parallel, eval, json, latencies, count, &failures)) {
+        exit(EXIT_FAILURE);
+    }
+
+    double elapsed = (now_nsec() - start_nsec) / 1e9;
+
+    long resources_after = bench_resources(&conns[0]);
+
+    for (size_t i = 0; i < parallel; ++i) {
+        wl_display_disconnect(conns[i].display);
+    }
+
+    qsort(latencies, count, sizeof(*latencies), latency_compare);
+
+    printf(
+        "%zu commands over %zu connection%s in %.3f s\n",
+        count,
+        parallel,
+        parallel == 1 ? "" : "s",
+        elapsed);
+    printf("%.1f commands/s\n", elapsed > 0 ? count / elapsed : 0);
+    printf(
+        "latency p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+        latency_percentile(latencies, count, 50),
+        latency_percentile(latencies, count, 99),
+        latencies[count - 1] / 1e6);
+
+    if (failures > 0) {
+        fprintf(stderr, "%zu commands failed\n", failures);
+    }
+
+    // Only a hint, the count covers every client of kiwmi. Older versions of
+    // kiwmi don't report their resources.
+    if (resources_before >= 0 && resources_after > resources_before) {
+        printf(
+            "kiwmi holds %ld more IPC resources than before "
+            "(other clients count too)\n",
+            resources_after - resources_before);
+    }
+
+    free(latencies);
+    free(conns);
+
+    return failures > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static const struct {
+    const char *name;
+    uint32_t type;
+} event_types[] = {
+    {"view_map", KIWMI_EVENT_STREAM_TYPE_VIEW_MAP},
+    {"view_unmap", KIWMI_EVENT_STREAM_TYPE_VIEW_UNMAP},
+    {"view_focus", KIWMI_EVENT_STREAM_TYPE_VIEW_FOCUS},
+    {"view_title", KIWMI_EVENT_STREAM_TYPE_VIEW_TITLE},
+    {"output_new", KIWMI_EVENT_STREAM_TYPE_OUTPUT_NEW},
+    {"output_destroy", KIWMI_EVENT_STREAM_TYPE_OUTPUT_DESTROY},
+    {"output_usable_area", KIWMI_EVENT_STREAM_TYPE_OUTPUT_USABLE_AREA},
+};
+
+#define EVENT_TYPES_COUNT (sizeof(event_types) / sizeof(event_types[0]))
+
+static const char *
+event_type_name(uint32_t type)
+{
+    for (size_t i = 0; i < EVENT_TYPES_COUNT; ++i) {
+        if (event_types[i].type == type) {
+            return event_types[i].name;
+        }
+    }
+
+    return "unknown";
+}
+
+// Parses a comma separated list of event types, NULL selects all of them.
+static bool
+event_types_parse(const char *list, uint32_t *types)
+{
+    *types = 0;
+
+    if (!list) {
+        for (size_t i = 0; i < EVENT_TYPES_COUNT; ++i) {
+            *types |= event_types[i].type;
+        }
+        return true;
+    }
+
+    while (*list) {
+        size_t len = strcspn(list, ",");
+
+        bool found = false;
+        for (size_t i = 0; i < EVENT_TYPES_COUNT; ++i) {
+            if (strlen(event_types[i].name) == len
+                && strncmp(event_types[i].name, list, len) == 0) {
+                *types |= event_types[i].type;
+                found = true;
+                break;
+            }
+        }
+
+        if (!found) {
+            fprintf(stderr, "Unknown event type '%.*s'\n", (int)len, list);
+            return false;
+        }
+
+        list += len;
+        if (*list == ',') {
+            ++list;
+        }
+    }
+
+    return true;
+}
+
+// One tab separated line per event, so it can be read with `read`.
+static void
+event_stream_view(
+    void *UNUSED(data),
+    struct kiwmi_event_stream *UNUSED(kiwmi_event_stream),
+    uint32_t type,
+    const char *id,
+    const char *app_id,
+    const char *title)
+{
+    printf("%s\t%s\t%s\t%s\n", event_type_name(type), id, app_id, title);
+    fflush(stdout);
+}
+
+static void
+event_stream_output(
+    void *UNUSED(data),
+    struct kiwmi_event_stream *UNUSED(kiwmi_event_stream),
+    uint32_t type,
+    const char *name,
+    int32_t x,
+    int32_t y,
+    int32_t width,
+    int32_t height)
+{
+    printf(
+        "%s\t%s\t%d\t%d\t%d\t%d\n",
+        event_type_name(type),
+        name,
+        x,
+        y,
+        width,
+        height);
+    fflush(stdout);
+}
+
+static const struct kiwmi_event_stream_listener event_stream_listener = {
+    .view   = event_stream_view,
+    .output = event_stream_output,
+};
+
+// Formats kiwmi:profile() as a table, slowest callbacks first.
+static const char *profile_command =
+    "local t = kiwmi:profile()\n"
+    "table.sort(t, function(a, b) return a.total > b.total end)\n"
+    "local lines = {string.format('%-24s %8s %10s %10s %10s %5s',"
+    " 'EVENT', 'CALLS', 'TOTAL', 'AVG', 'MAX', 'CBS')}\n"
+    "for _, p in ipairs(t) do\n"
+    "    lines[#lines + 1] = string.format("
+    "'%-24s %8d %10.3f %10.3f %10.3f %5s',"
+    " p.event, p.calls, p.total, p.avg, p.max, p.callbacks or '-')\n"
+    "end\n"
+    "return table.concat(lines, '\\n')\n";
+
+static void
+usage(void)
+{
+    fprintf(
+        stderr,
+        "Usage: kiwmic [-j] [-P | -r] [COMMAND]\n"
+        "       kiwmic [-j] [-f FILE | -]\n"
+        "       kiwmic [-j] -b N [-p P] COMMAND\n"
+        "       kiwmic -d NAME COMMAND\n"
+        "       kiwmic -c NAME [ARG...]\n"
+        "       kiwmic -s [TYPE,...]\n");
+    exit(EXIT_FAILURE);
+}
+
 int
 main(int argc, char **argv)
 {
-    if (argc < 2) {
-        fprintf(stderr, "Usage: kiwmic COMMAND\n");
-        exit(EXIT_FAILURE);
+    static const struct option long_options[] = {
+        {"bench", required_argument, NULL, 'b'},
+        {"call", required_argument, NULL, 'c'},
+        {"define", required_argument, NULL, 'd'},
+        {"file", required_argument, NULL, 'f'},
+        {"json", no_argument, NULL, 'j'},
+        {"parallel", required_argument, NULL, 'p'},
+        {"profile", no_argument, NULL, 'P'},
+        {"reload", no_argument, NULL, 'r'},
+        {"subscribe", no_argument, NULL, 's'},
+        {NULL, 0, NULL, 0},
+    };
+
+    const char *eval        = NULL;
+    const char *call_name   = NULL;
+    const char *define_name = NULL;
+    FILE *batch             = NULL;
+    bool subscribe          = false;
+    bool json               = false;
+    long bench              = 0;
+    long parallel           = 1;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "b:c:d:f:jp:Prs", long_options, NULL))
+           != -1) {
+        switch (opt) {
+        case 'b':
+            bench = strtol(optarg, NULL, 10);
+            if (bench <= 0) {
+                usage();
+            }
+            break;
+        case 'c':
+            call_name = optarg;
+            break;
+        case 'd':
+            define_name = optarg;
+            break;
+        case 'f':
+            batch = fopen(optarg, "r");
+            if (!batch) {
+                perror(optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'j':
+            json = true;
+            break;
+        case 'p':
+            parallel = strtol(optarg, NULL, 10);
+            if (parallel <= 0) {
+                usage();
+            }
+            break;
+        case 'P':
+            eval = profile_command;
+            break;
+        case 'r':
+            eval = "kiwmi:reload()";
+            break;
+        case 's':
+            subscribe = true;
+            break;
+        default:
+            usage();
+        }
     }
 
-    struct wl_display *display = wl_display_connect(NULL);
-    if (!display) {
-        fprintf(stderr, "Failed to connect to display\n");
+    int modes = !!eval + !!call_name + !!define_name + !!batch + subscribe
+                + !!bench;
+    if (modes > 1 || (json && (subscribe || call_name || define_name))
+        || (parallel != 1 && !bench)) {
+        usage();
+    }
+
+    if (bench) {
+        if (optind + 1 != argc) {
+            usage();
+        }
+
+        exit(bench_run(argv[optind], json, bench, parallel));
+    }
+
+    uint32_t types = 0;
+    if (subscribe) {
+        if (!event_types_parse(argv[optind], &types)) {
+            usage();
+        }
+    } else if (define_name) {
+        if (optind + 1 != argc) {
+            usage();
+        }
+    } else if (call_name) {
+        // the remaining arguments are passed to the command
+    } else if (batch) {
+        if (optind < argc) {
+            usage();
+        }
+    } else if (!eval) {
+        if (optind >= argc) {
+            usage();
+        }
+
+        if (strcmp(argv[optind], "-") == 0) {
+            batch = stdin;
+        } else {
+            eval = argv[optind];
+        }
+    }
+
+    struct wl_display *display;
+    struct kiwmi_ipc *ipc;
+    if (!ipc_connect(&display, &ipc)) {
         exit(EXIT_FAILURE);
     }
 
-    struct wl_registry *registry = wl_display_get_registry(display);
-    struct kiwmi_ipc *ipc        = NULL;
+    if (subscribe) {
+        if (kiwmi_ipc_get_version(ipc) < 2) {
+            fprintf(stderr, "kiwmi doesn't support event streams\n");
+            exit(EXIT_FAILURE);
+        }
 
-    wl_registry_add_listener(registry, &registry_listener, &ipc);
-    wl_display_roundtrip(display);
+        struct kiwmi_event_stream *stream = kiwmi_ipc_subscribe(ipc, types);
+        kiwmi_event_stream_add_listener(stream, &event_stream_listener, NULL);
 
-    if (!ipc) {
-        fprintf(stderr, "Failed to bind to kiwmi_ipc\n");
+        // Runs until kiwmi goes away.
+        while (wl_display_dispatch(display) != -1) {
+            // EMPTY
+        }
+
+        wl_display_disconnect(display);
+        exit(EXIT_SUCCESS);
+    }
+
+    if (json && kiwmi_ipc_get_version(ipc) < 4) {
+        fprintf(stderr, "kiwmi doesn't support JSON results\n");
         exit(EXIT_FAILURE);
     }
 
-    struct kiwmi_command *command = kiwmi_ipc_eval(ipc, argv[1]);
-    int exit_code;
-    kiwmi_command_add_listener(command, &command_listener, &exit_code);
+    if (batch) {
+        int exit_code = batch_run(display, ipc, batch, json);
+        wl_display_disconnect(display);
+        exit(exit_code);
+    }
+
+    if ((call_name || define_name) && kiwmi_ipc_get_version(ipc) < 3) {
+        fprintf(stderr, "kiwmi doesn't support named commands\n");
+        exit(EXIT_FAILURE);
+    }
+
+    struct kiwmi_command *command;
+    if (define_name) {
+        command = kiwmi_ipc_register_command(ipc, define_name, argv[optind]);
+    } else if (call_name) {
+        struct wl_array args;
+        wl_array_init(&args);
+
+        for (int i = optind; i < argc; ++i) {
+            size_t size = strlen(argv[i]) + 1;
+            char *arg   = wl_array_add(&args, size);
+            if (!arg) {
+                fprintf(stderr, "Failed to allocate memory\n");
+                exit(EXIT_FAILURE);
+            }
+            memcpy(arg, argv[i], size);
+        }
+
+        command = kiwmi_ipc_call_command(ipc, call_name, &args);
+        wl_array_release(&args);
+    } else {
+        command = command_send(ipc, eval, json);
+    }
+
+    struct command_reply reply;
+    command_reply_init(&reply);
+    kiwmi_command_add_listener(command, &command_listener, &reply);
     wl_display_roundtrip(display);
     wl_display_disconnect(display);
 
+    int exit_code = reply.done ? command_print(&reply) : EXIT_FAILURE;
+    wl_array_release(&reply.message);
+
     exit(exit_code);
 }
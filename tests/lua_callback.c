@@ -0,0 +1,245 @@
+/* Copyright (c), Niclas Meyer <niclas@countingsort.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this file,
+ * You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+// Removing callbacks while their signal is being emitted.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <lauxlib.h>
+#include <lualib.h>
+#include <wayland-server.h>
+
+#include "luak/gc.h"
+#include "luak/kiwmi_lua_callback.h"
+#include "luak/lua_compat.h"
+#include "luak/luak.h"
+#include "server.h"
+
+static struct wl_signal test_signal;
+
+// Just the parts of luaK_create() callbacks depend on.
+static struct kiwmi_lua *
+test_lua_create(struct kiwmi_server *server)
+{
+    struct kiwmi_lua *lua = malloc(sizeof(*lua));
+    if (!lua) {
+        return NULL;
+    }
+
+    lua_State *L = luaL_newstate();
+    if (!L) {
+        free(lua);
+        return NULL;
+    }
+
+    lua->L      = L;
+    lua->server = server;
+
+    luaL_openlibs(L);
+
+    wl_list_init(&lua->dead_callbacks);
+
+    lua->watchdog_ms         = 0;
+    lua->watchdog_abort      = false;
+    lua->watchdog_fired      = false;
+    lua->callback_start_nsec = 0;
+    lua->calls               = NULL;
+    lua->dead_callbacks_idle = NULL;
+
+    luaK_gc_init(lua, server->wl_event_loop);
+    luaK_watchdog_init(lua);
+
+    hashmap_init(&lua->objects);
+    luaK_userdata_cache_init(lua);
+
+    lua_pushcfunction(L, luaK_kiwmi_lua_callback_register);
+    lua_call(L, 0, 0);
+
+    return lua;
+}
+
+static void
+test_on_event_notify(struct wl_listener *listener, void *UNUSED(data))
+{
+    struct kiwmi_lua_callback *lc = wl_container_of(listener, lc, listener);
+    lua_State *L                  = lc->server->lua->L;
+
+    if (lc->dead) {
+        return;
+    }
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, lc->callback_ref);
+
+    if (luaK_callback_pcall(lc->server->lua, &lc->stats, 0, 0)) {
+        fprintf(stderr, "%s\n", lua_tostring(L, -1));
+        lua_pop(L, 1);
+    }
+}
+
+static int
+l_test_on_event(lua_State *L)
+{
+    struct kiwmi_object *obj =
+        *(struct kiwmi_object **)luaL_checkudata(L, 1, "kiwmi_test");
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+
+    lua_pushcfunction(L, luaK_kiwmi_lua_callback_new);
+    lua_pushlightuserdata(L, obj->lua->server);
+    lua_pushvalue(L, 2);
+    lua_pushlightuserdata(L, test_on_event_notify);
+    lua_pushlightuserdata(L, &test_signal);
+    lua_pushlightuserdata(L, obj);
+    lua_call(L, 5, 0);
+
+    return 0;
+}
+
+static const luaL_Reg kiwmi_test_methods[] = {
+    {"on", luaK_callback_register_dispatch},
+    {"once", luaK_callback_register_once},
+    {NULL, NULL},
+};
+
+static const luaL_Reg kiwmi_test_events[] = {
+    {"event", l_test_on_event},
+    {NULL, NULL},
+};
+
+static void
+test_register(lua_State *L)
+{
+    luaL_newmetatable(L, "kiwmi_test");
+
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+    luaC_setfuncs(L, kiwmi_test_methods, 0);
+
+    luaC_newlib(L, kiwmi_test_events);
+    lua_setfield(L, -2, "__events");
+
+    lua_pushcfunction(L, luaK_kiwmi_object_gc);
+    lua_setfield(L, -2, "__gc");
+
+    lua_pop(L, 1);
+}
+
+static bool
+expect_calls(lua_State *L, const char *expected)
+{
+    if (luaL_dostring(L, "return table.concat(calls, ',')")) {
+        fprintf(stderr, "%s\n", lua_tostring(L, -1));
+        lua_pop(L, 1);
+        return false;
+    }
+
+    const char *calls = lua_tostring(L, -1);
+
+    bool ok = strcmp(calls, expected) == 0;
+    if (!ok) {
+        fprintf(stderr, "expected calls '%s', got '%s'\n", expected, calls);
+    }
+
+    lua_pop(L, 1);
+    return ok;
+}
+
+static bool
+expect_listeners(int expected)
+{
+    int listeners = wl_list_length(&test_signal.listener_list);
+
+    bool ok = listeners == expected;
+    if (!ok) {
+        fprintf(
+            stderr, "expected %d listeners, got %d\n", expected, listeners);
+    }
+
+    return ok;
+}
+
+int
+main(void)
+{
+    struct kiwmi_server server = {0};
+
+    server.wl_event_loop = wl_event_loop_create();
+    if (!server.wl_event_loop) {
+        fprintf(stderr, "Failed to create event loop\n");
+        return EXIT_FAILURE;
+    }
+
+    struct kiwmi_lua *lua = test_lua_create(&server);
+    if (!lua) {
+        fprintf(stderr, "Failed to create Lua state\n");
+        return EXIT_FAILURE;
+    }
+
+    server.lua   = lua;
+    lua_State *L = lua->L;
+
+    wl_signal_init(&test_signal);
+    test_register(L);
+
+    static char object;
+    luaK_push_kiwmi_object(L, lua, &object, NULL, "kiwmi_test");
+    struct kiwmi_object *obj = *(struct kiwmi_object **)lua_touserdata(L, -1);
+    lua_setglobal(L, "obj");
+
+    // The first handler removes the one wl_signal_emit() is going to call
+    // next, the once handler removes itself.
+    const char *setup =
+        "calls = {}\n"
+        "local second\n"
+        "obj:on('event', function()\n"
+        "    calls[#calls + 1] = 'first'\n"
+        "    second:off()\n"
+        "end)\n"
+        "second = obj:on('event', function()\n"
+        "    calls[#calls + 1] = 'second'\n"
+        "end)\n"
+        "obj:once('event', function()\n"
+        "    calls[#calls + 1] = 'once'\n"
+        "end)\n"
+        "obj:on('event', function()\n"
+        "    calls[#calls + 1] = 'last'\n"
+        "end)\n";
+
+    if (luaL_dostring(L, setup)) {
+        fprintf(stderr, "%s\n", lua_tostring(L, -1));
+        return EXIT_FAILURE;
+    }
+
+    bool ok = expect_listeners(4);
+
+    wl_signal_emit(&test_signal, NULL);
+    ok &= expect_calls(L, "first,once,last");
+
+    // Only gone after the next idle.
+    ok &= expect_listeners(4);
+    wl_event_loop_dispatch_idle(server.wl_event_loop);
+    ok &= expect_listeners(2);
+
+    wl_signal_emit(&test_signal, NULL);
+    ok &= expect_calls(L, "first,once,last,first,last");
+
+    struct kiwmi_lua_callback *lc;
+    struct kiwmi_lua_callback *tmp;
+    wl_list_for_each_safe (lc, tmp, &obj->callbacks, link) {
+        luaK_callback_destroy(lua, lc);
+    }
+
+    luaK_gc_fini(lua);
+    lua_close(L);
+    hashmap_fini(&lua->objects);
+    free(lua);
+
+    wl_event_loop_destroy(server.wl_event_loop);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}